@@ -0,0 +1,364 @@
+#include "ClientConnection.h"
+#include "Server.h"
+#include "Metrics.h"
+#include "StatsReport.h"
+
+ClientConnection::ClientConnection(Server* server, DbExecutor* executor, QTcpSocket* socket, QObject *parent)
+    : QObject(parent), server(server), executor(executor), clientSocket(socket),
+      guard(std::make_shared<ResultGuard>(this)) {
+    lastActivity.start();
+    clientSocket->setParent(this);
+    // Непрочитанное из сокета не копится сверх этого: дальше ждёт в ядре
+    clientSocket->setReadBufferSize(Protocol::MaxLineSize);
+    connect(clientSocket, &QTcpSocket::readyRead, this, &ClientConnection::onReadyRead);
+    connect(clientSocket, &QTcpSocket::bytesWritten, this, &ClientConnection::onBytesWritten);
+    connect(clientSocket, &QTcpSocket::disconnected, this, &ClientConnection::deleteLater);
+}
+
+ClientConnection::~ClientConnection() {
+    guard->invalidate(); // Ответы на незавершённые запросы больше некому отдавать
+    if (userId != -1) {
+        server->userRegistry().remove(userId, this);
+    }
+}
+
+void ClientConnection::send(const QByteArray& data) {
+    if (clientSocket->state() != QAbstractSocket::ConnectedState) {
+        return;
+    }
+    if (pendingOutput() + data.size() > MaxPendingOutput) {
+        // События не ждут клиента, поэтому у медленного очередь только растёт
+        qWarning() << "Client is not reading its events, disconnecting";
+        clientSocket->abort();
+        return;
+    }
+    eventBytes += quint64(data.size());
+    outBuffer.append(data);
+    scheduleFlush();
+}
+
+void ClientConnection::sendEvent(const QByteArray& textEvent, const QByteArray& binaryEvent) {
+    send(mode == Protocol::Mode::Text ? textEvent : binaryEvent);
+}
+
+void ClientConnection::setAuthenticatedUser(int userId) {
+    if (this->userId == userId) {
+        return;
+    }
+    if (this->userId != -1) {
+        server->userRegistry().remove(this->userId, this);
+    }
+    this->userId = userId;
+    server->userRegistry().add(userId, this);
+}
+
+Protocol::ReplyWriter ClientConnection::reply(Protocol::Reply type) {
+    scheduleFlush();
+    return Protocol::ReplyWriter(&outBuffer, mode, type, currentRequestId);
+}
+
+Protocol::ReplyWriter ClientConnection::fail(Protocol::Reply type) {
+    commandFailed = true;
+    Protocol::ReplyWriter writer = reply(type);
+    writer << "fail";
+    return writer;
+}
+
+void ClientConnection::rejectBusy(Protocol::Reply command) {
+    fail(command) << "server busy";
+}
+
+void ClientConnection::scheduleFlush() {
+    if (flushScheduled) {
+        return;
+    }
+    flushScheduled = true;
+    // Отложенный вызов выполнится после текущих событий цикла: все ответы,
+    // накопленные за этот проход, уйдут одной записью в сокет
+    QMetaObject::invokeMethod(this, &ClientConnection::flush, Qt::QueuedConnection);
+}
+
+void ClientConnection::flush() {
+    flushScheduled = false;
+    if (!outBuffer.isEmpty()) {
+        clientSocket->write(outBuffer);
+        flushedBytes += quint64(outBuffer.size());
+        Metrics::recordBytesOut(quint64(outBuffer.size()));
+        outBuffer.clear();
+    }
+}
+
+void ClientConnection::streamReplies(int count, std::function<void(int)> write, std::function<void()> finish) {
+    continueStream(0, count, write, finish);
+}
+
+void ClientConnection::continueStream(int from, int count, const std::function<void(int)>& write,
+                                      const std::function<void()>& finish) {
+    int i = from;
+    while (i < count && !outputFull()) {
+        write(i++);
+    }
+    if (i < count) {
+        whenDrained([this, i, count, write, finish]() { continueStream(i, count, write, finish); });
+        return;
+    }
+    finish();
+}
+
+void ClientConnection::whenDrained(std::function<void()> next) {
+    if (pendingOutput() <= LowWatermark) {
+        next();
+        return;
+    }
+    // Команда продолжится в onBytesWritten, до тех пор остальные ждут
+    busy = true;
+    drained = std::move(next);
+}
+
+void ClientConnection::onBytesWritten() {
+    lastActivity.restart();
+    if (pendingOutput() > LowWatermark) {
+        return;
+    }
+    if (drained) {
+        std::function<void()> next = std::move(drained);
+        drained = nullptr;
+        busy = false;
+        next();
+        if (busy) {
+            return;
+        }
+        finishCommand();
+    }
+    processPending();
+}
+
+// Порядок совпадает с Protocol::Command
+const ClientConnection::Handler ClientConnection::handlers[int(Protocol::Command::Count)] = {
+    &ClientConnection::handleRegister,
+    &ClientConnection::handleLogin,
+    &ClientConnection::handleSearch,
+    &ClientConnection::handleCreateChat,
+    &ClientConnection::handleGetChats,
+    &ClientConnection::handleSendMessage,
+    &ClientConnection::handleGetMessages,
+    &ClientConnection::handleGetUserId,
+    &ClientConnection::handleSetProtocol,
+    &ClientConnection::handleMarkRead,
+    &ClientConnection::handleStats,
+};
+
+void ClientConnection::onReadyRead() {
+    lastActivity.restart();
+    // Пока ответы не уходят или разобранные команды ждут своей очереди,
+    // данные остаются в ограниченном буфере сокета, и TCP притормаживает клиента
+    const int buffered = mode == Protocol::Mode::Text ? framer.bufferedBytes() : frameReader.bufferedBytes();
+    if (outputFull() || (busy && buffered >= Protocol::MaxLineSize)) {
+        readPaused = true;
+        return;
+    }
+    readPaused = false;
+    if (mode == Protocol::Mode::Text) {
+        framer.append(clientSocket->readAll());
+    } else {
+        frameReader.append(clientSocket->readAll());
+    }
+    processPending();
+}
+
+void ClientConnection::processPending() {
+    const char* data;
+    int size;
+    while (!busy && !outputFull())
+    {
+        if (mode == Protocol::Mode::Text)
+        {
+            if (!framer.nextLine(&data, &size))
+            {
+                break;
+            }
+            handleLine(data, size);
+        }
+        else
+        {
+            if (!frameReader.nextFrame(&data, &size))
+            {
+                break;
+            }
+            handleFrame(data, size);
+        }
+    }
+    if (!busy && (framer.overflowed() || frameReader.overflowed()))
+    {
+        qWarning() << "Client sent a command longer than" << Protocol::MaxLineSize << "bytes, disconnecting";
+        clientSocket->abort();
+        return;
+    }
+    if (readPaused && !busy && !outputFull() && clientSocket->bytesAvailable() > 0) {
+        onReadyRead();
+    }
+}
+
+void ClientConnection::handleLine(const char* line, int size) {
+    Protocol::FieldView fields[Protocol::MaxFields];
+    int nameSize = 0;
+    while (nameSize < size && line[nameSize] != ':')
+    {
+        ++nameSize;
+    }
+    const Protocol::CommandSpec* spec = Protocol::findCommand(line, nameSize);
+    if (spec == nullptr)
+    {
+        qDebug() << "Unknown command:" << QByteArray(line, nameSize);
+        Metrics::recordUnknownCommand();
+        return;
+    }
+    int count = Protocol::splitFields(line, size, fields, spec->maxFields);
+    dispatch(spec->command, fields, count, size + 1);
+}
+
+void ClientConnection::handleFrame(const char* frame, int size) {
+    Protocol::FieldView fields[Protocol::MaxFields];
+    Protocol::Command command;
+    quint32 requestId = 0;
+    int count = Protocol::decodeFrame(frame, size, &command, &requestId, fields, Protocol::MaxFields);
+    if (count < 0)
+    {
+        qWarning() << "Malformed binary frame, disconnecting";
+        clientSocket->abort();
+        return;
+    }
+    currentRequestId = requestId;
+    dispatch(command, fields, count, size + 4);
+}
+
+void ClientConnection::dispatch(Protocol::Command command, const Protocol::FieldView* fields, int count, int bytesIn) {
+    activeCommand = command;
+    commandStart = Metrics::nowMicros();
+    commandBytesIn = bytesIn;
+    commandReplyMark = replyBytes();
+    commandFailed = false;
+    const Protocol::CommandSpec* spec = Protocol::commandSpec(command);
+    if (count < spec->minFields)
+    {
+        qDebug() << "Not enough fields for command" << spec->name;
+        commandFailed = true;
+        finishCommand();
+        return;
+    }
+    (this->*handlers[int(command)])(fields);
+    // Асинхронная команда завершится в await, когда придёт результат
+    if (!busy)
+    {
+        finishCommand();
+    }
+}
+
+void ClientConnection::finishCommand() {
+    if (activeCommand == Protocol::Command::Count) {
+        return;
+    }
+    Metrics::recordCommand(activeCommand, Metrics::nowMicros() - commandStart, quint64(commandBytesIn),
+                           replyBytes() - commandReplyMark, commandFailed);
+    activeCommand = Protocol::Command::Count;
+}
+
+void ClientConnection::handleRegister(const Protocol::FieldView* fields) {
+    server->processRegistration(this, fields[1].toString(), fields[2].toString());
+}
+
+void ClientConnection::handleLogin(const Protocol::FieldView* fields) {
+    server->processLogin(this, fields[1].toString(), fields[2].toString());
+}
+
+void ClientConnection::handleSearch(const Protocol::FieldView* fields) {
+    // search:<text>[:<limit>[:<offset>]]
+    int limit = fields[2].isEmpty() ? Server::DefaultSearchResults : fields[2].toInt();
+    int offset = fields[3].isEmpty() ? 0 : fields[3].toInt();
+    server->processSearchRequest(this, fields[1].toString(), offset, limit);
+}
+
+void ClientConnection::handleCreateChat(const Protocol::FieldView* fields) {
+    server->processCreateChat(this, fields[1].toString(), fields[2].toString(),
+                              fields[3].toString(), fields[4].toString());
+}
+
+void ClientConnection::handleGetChats(const Protocol::FieldView* fields) {
+    // get_chats[:<login>] - список чатов вошедшего пользователя; логин
+    // старых клиентов не используется
+    Q_UNUSED(fields);
+    if (userId == -1) {
+        fail(Protocol::Reply::GetChats) << "not logged in";
+        return;
+    }
+    server->processGetChats(this, userId);
+}
+
+void ClientConnection::handleSendMessage(const Protocol::FieldView* fields) {
+    // send_message:<chat_id>:<user_id>:<text> - отправитель берётся из
+    // сессии, присланный user_id оставлен для совместимости и не используется
+    if (userId == -1) {
+        fail(Protocol::Reply::SendMessage) << "not logged in";
+        return;
+    }
+    server->processSendMessage(this, fields[1].toInt(), userId, fields[3].toString());
+}
+
+void ClientConnection::handleGetMessages(const Protocol::FieldView* fields) {
+    // get_messages:<chat_id>[:<limit>[:before|after:<message_id>]]
+    MessageCursor cursor;
+    cursor.chatId = fields[1].toInt();
+    if (!fields[2].isEmpty()) {
+        cursor.limit = qBound(1, fields[2].toInt(), Server::MaxPageSize);
+        const QString direction = fields[3].toString();
+        if (direction == "before") {
+            cursor.direction = MessageCursor::Before;
+            cursor.messageId = fields[4].toInt();
+        } else if (direction == "after") {
+            cursor.direction = MessageCursor::After;
+            cursor.messageId = fields[4].toInt();
+        }
+    }
+    server->getMessagesForChat(this, cursor);
+}
+
+void ClientConnection::handleGetUserId(const Protocol::FieldView* fields) {
+    server->getUserId(this, fields[1].toString());
+}
+
+void ClientConnection::handleSetProtocol(const Protocol::FieldView* fields) {
+    if (fields[1].toString() != "binary" || mode == Protocol::Mode::Binary) {
+        fail(Protocol::Reply::SetProtocol);
+        return;
+    }
+    // Подтверждение уходит ещё в текстовом виде, всё после этой строки - кадры
+    reply(Protocol::Reply::SetProtocol) << "binary";
+    mode = Protocol::Mode::Binary;
+    frameReader.append(framer.takeRemaining());
+}
+
+void ClientConnection::handleMarkRead(const Protocol::FieldView* fields) {
+    // mark_read:<chat_id>:<message_id> - отметка ставится вошедшему пользователю
+    if (userId == -1) {
+        fail(Protocol::Reply::MarkRead) << "not logged in";
+        return;
+    }
+    server->processMarkRead(this, fields[1].toInt(), userId, fields[2].toInt());
+}
+
+void ClientConnection::handleStats(const Protocol::FieldView* fields) {
+    Q_UNUSED(fields);
+    // Внутренние показатели сервера отдаём только локальным клиентам
+    if (!clientSocket->peerAddress().isLoopback()) {
+        fail(Protocol::Reply::Stats) << "forbidden";
+        return;
+    }
+    StatsReport report(server);
+    for (const StatsReport::Family& family : report.families()) {
+        for (const StatsReport::Sample& sample : family.samples) {
+            reply(Protocol::Reply::StatItem) << QString::fromLatin1(family.name + sample.suffix + sample.labels)
+                                                << QString::number(sample.value, 'g', 15);
+        }
+    }
+    reply(Protocol::Reply::EndOfStats);
+}
@@ -0,0 +1,156 @@
+#ifndef CLIENTCONNECTION_H
+#define CLIENTCONNECTION_H
+
+#include <QObject>
+#include <QTcpSocket>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <memory>
+#include "DbExecutor.h"
+#include "Protocol.h"
+
+class Server;
+
+// Одно клиентское подключение. Живёт в потоке своего реактора вместе с
+// сокетом; разбирает входящие команды и передаёт их обработчикам Server.
+// SQL выполняется в DbExecutor; пока запрос подключения не завершён,
+// следующие его команды ждут в буфере приёма, чтобы ответы шли в порядке
+// запросов. Все ответы, сформированные за один проход цикла событий,
+// копятся в outBuffer и уходят в сокет одной записью.
+//
+// Исходящие данные подключения ограничены. Пока неотправленного больше
+// HighWatermark, новые команды не разбираются и сокет не читается (клиент
+// упирается в TCP-окно); работа продолжается, когда очередь опустится до
+// LowWatermark. Длинные ответы пишутся частями через streamReplies, а
+// клиента, который не забирает события, отключаем при MaxPendingOutput.
+class ClientConnection : public QObject {
+    Q_OBJECT
+
+public:
+    ClientConnection(Server* server, DbExecutor* executor, QTcpSocket* socket, QObject *parent = nullptr);
+    ~ClientConnection();
+    QTcpSocket* socket() const { return clientSocket; }
+    // Вызывается только из потока подключения (см. UserRegistry::post).
+    void send(const QByteArray& data);
+    void sendEvent(const QByteArray& textEvent, const QByteArray& binaryEvent);
+    // Привязывает подключение к пользователю после успешного входа.
+    void setAuthenticatedUser(int userId);
+    int authenticatedUser() const { return userId; }
+    // Сколько миллисекунд сокет не принимал и не отправлял данных.
+    qint64 idleMs() const { return lastActivity.elapsed(); }
+    Protocol::Mode protocolMode() const { return mode; }
+
+    // Начинает ответ на текущий запрос: client->reply(Reply::Login) << "success";
+    Protocol::ReplyWriter reply(Protocol::Reply type);
+    // Ответ об ошибке: "<type>:fail"; команда учитывается в метриках как ошибка.
+    Protocol::ReplyWriter fail(Protocol::Reply type);
+
+    // Выполняет work в потоке БД, затем done(результат) в потоке подключения.
+    // Если очередь БД переполнена, клиент получает "<command>:fail:server busy".
+    template <typename Work, typename Done>
+    void query(Protocol::Reply command, Work work, Done done)
+    {
+        typedef decltype(work()) Result;
+        DbExecutor* executor = this->executor;
+        await<Result>(command, [executor, work](const std::shared_ptr<ResultGuard>& guard,
+                                                const std::function<void(const Result&)>& resume) {
+            return executor->submit(guard, work, resume);
+        }, done);
+    }
+
+    // Пишет count строк ответа: write(i) формирует i-ю. Если исходящая
+    // очередь переполнена, остаток дописывается по мере отправки, а
+    // следующие команды подключения ждут. finish() вызывается после
+    // последней строки и может начать следующую часть ответа (query и т.п.).
+    void streamReplies(int count, std::function<void(int)> write, std::function<void()> finish);
+    // Вызывает next, когда исходящая очередь опустится до LowWatermark.
+    void whenDrained(std::function<void()> next);
+
+    static const int HighWatermark = 256 * 1024;
+    static const int LowWatermark = 64 * 1024;
+    static const int MaxPendingOutput = 4 * 1024 * 1024;
+
+    // Общий случай query: submit(guard, resume) отдаёт работу любому исполнителю,
+    // который потом вызовет resume(результат) через guard. Пока результата нет,
+    // следующие команды подключения ждут. submit возвращает false, если
+    // исполнитель перегружен.
+    template <typename Result, typename Submit, typename Done>
+    void await(Protocol::Reply command, Submit submit, Done done)
+    {
+        busy = true;
+        std::function<void(const Result&)> resume = [this, done](const Result& result) {
+            busy = false;
+            done(result);
+            // done мог продолжить ответ следующим запросом
+            if (!busy)
+            {
+                finishCommand();
+                processPending();
+            }
+        };
+        if (!submit(guard, resume))
+        {
+            busy = false;
+            rejectBusy(command);
+        }
+    }
+
+private slots:
+    void onReadyRead();
+    void onBytesWritten();
+
+private:
+    void processPending();
+    void continueStream(int from, int count, const std::function<void(int)>& write,
+                        const std::function<void()>& finish);
+    qint64 pendingOutput() const { return outBuffer.size() + clientSocket->bytesToWrite(); }
+    bool outputFull() const { return pendingOutput() >= HighWatermark; }
+    void handleLine(const char* line, int size);
+    void handleFrame(const char* frame, int size);
+    void dispatch(Protocol::Command command, const Protocol::FieldView* fields, int count, int bytesIn);
+    void finishCommand();
+    quint64 replyBytes() const { return flushedBytes + quint64(outBuffer.size()) - eventBytes; }
+    void rejectBusy(Protocol::Reply command);
+    void scheduleFlush();
+    void flush();
+
+    typedef void (ClientConnection::*Handler)(const Protocol::FieldView* fields);
+    static const Handler handlers[int(Protocol::Command::Count)];
+    void handleRegister(const Protocol::FieldView* fields);
+    void handleLogin(const Protocol::FieldView* fields);
+    void handleSearch(const Protocol::FieldView* fields);
+    void handleCreateChat(const Protocol::FieldView* fields);
+    void handleGetChats(const Protocol::FieldView* fields);
+    void handleSendMessage(const Protocol::FieldView* fields);
+    void handleGetMessages(const Protocol::FieldView* fields);
+    void handleGetUserId(const Protocol::FieldView* fields);
+    void handleSetProtocol(const Protocol::FieldView* fields);
+    void handleMarkRead(const Protocol::FieldView* fields);
+    void handleStats(const Protocol::FieldView* fields);
+
+    Server* server;
+    DbExecutor* executor;
+    QTcpSocket* clientSocket;
+    std::shared_ptr<ResultGuard> guard;
+    Protocol::Mode mode = Protocol::Mode::Text;
+    Protocol::LineFramer framer;
+    Protocol::FrameReader frameReader;
+    quint32 currentRequestId = 0; // id запроса, на который сейчас отвечаем
+    QByteArray outBuffer;
+    bool flushScheduled = false;
+    bool busy = false;
+    bool readPaused = false;             // Чтение ждёт, пока уйдут исходящие данные
+    std::function<void()> drained;       // Продолжение ответа, см. whenDrained
+    // Текущая команда для метрик: от разбора до последнего ответа
+    Protocol::Command activeCommand = Protocol::Command::Count;
+    quint64 commandStart = 0;
+    int commandBytesIn = 0;
+    quint64 commandReplyMark = 0;
+    bool commandFailed = false;
+    quint64 flushedBytes = 0; // Всего записано в сокет
+    quint64 eventBytes = 0;   // Из них события, а не ответы на команды
+    int userId = -1; // Заполняется после успешного входа
+    QElapsedTimer lastActivity;
+};
+
+#endif // CLIENTCONNECTION_H
@@ -0,0 +1,99 @@
+#include "DbExecutor.h"
+#include "Storage.h"
+#include <QDebug>
+
+// Поток БД: открывает своё соединение и разбирает общую очередь запросов.
+class DbWorkerThread : public QThread
+{
+public:
+    explicit DbWorkerThread(DbExecutor* executor) : executor(executor) {}
+
+protected:
+    void run() override
+    {
+        executor->storage->attachThread();
+        executor->workerLoop();
+        executor->storage->releaseThread();
+    }
+
+private:
+    DbExecutor* executor;
+};
+
+DbExecutor::DbExecutor(Storage* storage, int threadCount, int capacity)
+    : storage(storage), capacity(capacity), rejected(0)
+{
+    if (threadCount < 1)
+    {
+        threadCount = 1;
+    }
+    for (int i = 0; i < threadCount; ++i)
+    {
+        QThread* worker = new DbWorkerThread(this);
+        worker->setObjectName(QString("db-worker-%1").arg(i));
+        worker->start();
+        workers.append(worker);
+    }
+}
+
+DbExecutor::~DbExecutor()
+{
+    shutdown();
+}
+
+void DbExecutor::shutdown()
+{
+    {
+        QMutexLocker locker(&mutex);
+        stopping = true; // Уже принятые запросы всё равно выполняются
+    }
+    notEmpty.wakeAll();
+    for (QThread* worker : workers)
+    {
+        worker->wait();
+        delete worker;
+    }
+    workers.clear();
+}
+
+bool DbExecutor::submit(std::function<void()> job)
+{
+    {
+        QMutexLocker locker(&mutex);
+        if (stopping || jobs.size() >= capacity)
+        {
+            rejected.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        jobs.enqueue(std::move(job));
+    }
+    notEmpty.wakeOne();
+    return true;
+}
+
+int DbExecutor::queueDepth() const
+{
+    QMutexLocker locker(&mutex);
+    return jobs.size();
+}
+
+void DbExecutor::workerLoop()
+{
+    for (;;)
+    {
+        std::function<void()> job;
+        {
+            QMutexLocker locker(&mutex);
+            while (jobs.isEmpty() && !stopping)
+            {
+                notEmpty.wait(&mutex);
+            }
+            if (jobs.isEmpty())
+            {
+                return; // stopping и очередь пуста
+            }
+            job = jobs.dequeue();
+        }
+        job();
+    }
+}
@@ -0,0 +1,97 @@
+#ifndef DBEXECUTOR_H
+#define DBEXECUTOR_H
+
+#include <QObject>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QQueue>
+#include <QVector>
+#include <QThread>
+#include <atomic>
+#include <functional>
+#include <memory>
+
+// Получатель результатов запроса. Поток БД не может просто так обратиться к
+// объекту из другого потока: тот может быть удалён, пока выполняется запрос.
+// Владелец вызывает invalidate() в деструкторе, после чего результаты
+// молча отбрасываются.
+class ResultGuard
+{
+public:
+    explicit ResultGuard(QObject* target) : target(target) {}
+
+    void invalidate()
+    {
+        QMutexLocker locker(&mutex);
+        target = nullptr;
+    }
+
+    // Ставит вызов function в очередь потока получателя.
+    template <typename Function>
+    bool post(Function function)
+    {
+        QMutexLocker locker(&mutex);
+        if (target == nullptr)
+        {
+            return false;
+        }
+        QMetaObject::invokeMethod(target, function, Qt::QueuedConnection);
+        return true;
+    }
+
+private:
+    QMutex mutex;
+    QObject* target;
+};
+
+class Storage;
+
+// Пул потоков для SQL-запросов. У каждого потока своё соединение с базой
+// (см. Storage::attachThread()), поэтому медленный запрос одного клиента не
+// останавливает обработку сокетов остальных. Очередь ограничена: если она
+// заполнена, submit() возвращает false и запрос нужно отклонить.
+class DbExecutor
+{
+public:
+    DbExecutor(Storage* storage, int threadCount, int capacity);
+    ~DbExecutor();
+
+    bool submit(std::function<void()> job);
+    // Перестаёт принимать запросы, дорабатывает принятые и останавливает
+    // потоки. После этого submit() возвращает false, но объект остаётся
+    // живым для тех, кто ещё держит на него указатель. Вызывается и из
+    // деструктора.
+    void shutdown();
+
+    // work выполняется в потоке БД, done(результат) - в потоке guard.
+    template <typename Work, typename Done>
+    bool submit(const std::shared_ptr<ResultGuard>& guard, Work work, Done done)
+    {
+        return submit(std::function<void()>([guard, work, done]() {
+            typedef decltype(work()) Result;
+            Result result = work();
+            guard->post([done, result]() { done(result); });
+        }));
+    }
+
+    int queueDepth() const;
+    int queueCapacity() const { return capacity; }
+    int threadCount() const { return workers.size(); }
+    quint64 rejectedCount() const { return rejected.load(std::memory_order_relaxed); }
+
+private:
+    void workerLoop();
+
+    Storage* storage;
+    mutable QMutex mutex;
+    QWaitCondition notEmpty;
+    QQueue<std::function<void()>> jobs;
+    bool stopping = false;
+    int capacity;
+    QVector<QThread*> workers;
+    std::atomic<quint64> rejected;
+
+    friend class DbWorkerThread;
+};
+
+#endif // DBEXECUTOR_H
@@ -0,0 +1,359 @@
+#include "EventBus.h"
+#include <QCoreApplication>
+#include <QDataStream>
+#include <QDir>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QLockFile>
+#include <QRandomGenerator>
+#include <QTimer>
+#include <QtEndian>
+#include <QDebug>
+
+EventBus::EventBus(const QString& name, MessageHandler onMessage, UserHandler onUser, QObject *parent)
+    : QObject(parent), name(name), instanceId(QString::number(QCoreApplication::applicationPid())),
+      onMessage(onMessage), onUser(onUser),
+      hubLock(new QLockFile(QDir(QDir::tempPath()).filePath(name + ".lock"))),
+      retryTimer(new QTimer(this))
+{
+    hubLock->setStaleLockTime(0); // Блокировка умершего процесса снимается по PID, а не по времени
+    retryTimer->setSingleShot(true);
+    connect(retryTimer, &QTimer::timeout, this, &EventBus::connectToBus);
+}
+
+EventBus::~EventBus()
+{
+    if (hub != nullptr)
+    {
+        hub->disconnect(this);
+    }
+    for (QLocalSocket* peer : peers.keys())
+    {
+        peer->disconnect(this);
+    }
+    delete server;
+    server = nullptr;
+    delete hubLock;
+}
+
+void EventBus::start()
+{
+    connectToBus();
+}
+
+template <typename Body>
+QByteArray EventBus::frame(FrameType type, const QString& origin, Body body) const
+{
+    QByteArray frame;
+    QDataStream out(&frame, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_10);
+    out << quint32(0) << quint8(type) << origin;
+    body(out);
+    qToBigEndian(quint32(frame.size() - 4), frame.data());
+    return frame;
+}
+
+void EventBus::connectToBus()
+{
+    if (hubLock->tryLock(0))
+    {
+        // Файл сокета мог остаться от упавшего концентратора
+        QLocalServer::removeServer(name);
+        server = new QLocalServer(this);
+        server->setSocketOptions(QLocalServer::UserAccessOption);
+        if (!server->listen(name))
+        {
+            qCritical() << "Event bus: could not listen on" << name << ":" << server->errorString();
+            delete server;
+            server = nullptr;
+            hubLock->unlock();
+            scheduleRetry();
+            return;
+        }
+        connect(server, &QLocalServer::newConnection, this, &EventBus::onPeerConnected);
+        qDebug() << "Event bus: this process is the hub on" << name;
+        return;
+    }
+    hub = new QLocalSocket(this);
+    connect(hub, &QLocalSocket::connected, this, [this]() {
+        qDebug() << "Event bus: connected to the hub on" << name;
+        hub->write(snapshot(instanceId, localUsers));
+    });
+    connect(hub, &QLocalSocket::readyRead, this, [this]() { readFrames(hub); });
+    connect(hub, &QLocalSocket::disconnected, this, &EventBus::onHubLost);
+#if QT_VERSION >= QT_VERSION_CHECK(5, 15, 0)
+    connect(hub, &QLocalSocket::errorOccurred, this, &EventBus::onHubLost);
+#else
+    connect(hub, QOverload<QLocalSocket::LocalSocketError>::of(&QLocalSocket::error), this, &EventBus::onHubLost);
+#endif
+    hub->connectToServer(name);
+}
+
+void EventBus::scheduleRetry()
+{
+    // Разброс, чтобы оставшиеся процессы не спорили за блокировку одновременно
+    retryTimer->start(200 + QRandomGenerator::global()->bounded(300));
+}
+
+void EventBus::onHubLost()
+{
+    if (hub == nullptr)
+    {
+        return; // error и disconnected приходят для одного разрыва
+    }
+    if (hub->state() == QLocalSocket::ConnectedState)
+    {
+        return; // Ошибка записи без разрыва
+    }
+    hub->disconnect(this);
+    hub->deleteLater();
+    hub = nullptr;
+    buffers.clear();
+    clearRemoteUsers();
+    scheduleRetry();
+}
+
+void EventBus::onPeerConnected()
+{
+    while (QLocalSocket* peer = server->nextPendingConnection())
+    {
+        peers.insert(peer, QString());
+        connect(peer, &QLocalSocket::readyRead, this, [this, peer]() { readFrames(peer); });
+        connect(peer, &QLocalSocket::disconnected, this, [this, peer]() { dropPeer(peer); });
+        // Новому процессу - присутствие всех уже известных
+        peer->write(snapshot(instanceId, localUsers));
+        QMutexLocker locker(&mutex);
+        for (auto it = remoteUsers.constBegin(); it != remoteUsers.constEnd(); ++it)
+        {
+            peer->write(snapshot(it.key(), it.value()));
+        }
+    }
+}
+
+void EventBus::dropPeer(QLocalSocket* peer)
+{
+    const QString instance = peers.take(peer);
+    buffers.remove(peer);
+    peer->disconnect(this);
+    peer->deleteLater();
+    if (!instance.isEmpty())
+    {
+        setRemoteUsers(instance, QSet<int>());
+        {
+            QMutexLocker locker(&mutex);
+            remoteUsers.remove(instance);
+        }
+        send(frame(GoneFrame, instance, [](QDataStream&) {}));
+    }
+}
+
+void EventBus::readFrames(QLocalSocket* socket)
+{
+    QByteArray& buffer = buffers[socket];
+    buffer.append(socket->readAll());
+    int offset = 0;
+    while (buffer.size() - offset >= 4)
+    {
+        const quint32 length = qFromBigEndian<quint32>(buffer.constData() + offset);
+        if (length > quint32(MaxFrameSize))
+        {
+            qCritical() << "Event bus: oversized frame, dropping the connection";
+            buffers.remove(socket);
+            socket->abort();
+            return;
+        }
+        if (quint32(buffer.size() - offset - 4) < length)
+        {
+            break;
+        }
+        handleFrame(socket, buffer.mid(offset, int(length) + 4));
+        offset += int(length) + 4;
+        if (!buffers.contains(socket))
+        {
+            return; // Подключение закрыто при разборе
+        }
+    }
+    buffer.remove(0, offset);
+}
+
+void EventBus::handleFrame(QLocalSocket* from, const QByteArray& frame)
+{
+    QDataStream in(frame);
+    in.setVersion(QDataStream::Qt_5_10);
+    quint32 length;
+    quint8 type;
+    QString origin;
+    in >> length >> type >> origin;
+    if (origin == instanceId)
+    {
+        return;
+    }
+    if (server != nullptr)
+    {
+        QString& instance = peers[from];
+        if (instance.isEmpty())
+        {
+            instance = origin;
+        }
+        // Концентратор пересылает кадр остальным как есть
+        send(frame, from);
+    }
+    switch (type)
+    {
+    case MessageFrame:
+    {
+        QVector<int> userIds;
+        QByteArray textEvent;
+        QByteArray binaryEvent;
+        in >> userIds >> textEvent >> binaryEvent;
+        onMessage(userIds, textEvent, binaryEvent);
+        break;
+    }
+    case UserFrame:
+    {
+        QString login;
+        qint32 userId;
+        in >> login >> userId;
+        onUser(login, userId);
+        break;
+    }
+    case PresenceFrame:
+    {
+        qint32 userId;
+        bool online;
+        in >> userId >> online;
+        setRemoteUser(origin, userId, online);
+        break;
+    }
+    case SnapshotFrame:
+    {
+        QSet<int> users;
+        in >> users;
+        setRemoteUsers(origin, users);
+        break;
+    }
+    case GoneFrame:
+    {
+        setRemoteUsers(origin, QSet<int>());
+        QMutexLocker locker(&mutex);
+        remoteUsers.remove(origin);
+        break;
+    }
+    default:
+        qWarning() << "Event bus: unknown frame type" << type;
+        break;
+    }
+}
+
+void EventBus::send(const QByteArray& frame, QLocalSocket* except)
+{
+    if (server != nullptr)
+    {
+        for (QLocalSocket* peer : peers.keys())
+        {
+            if (peer != except)
+            {
+                peer->write(frame);
+            }
+        }
+    }
+    else if (hub != nullptr && hub->state() == QLocalSocket::ConnectedState)
+    {
+        hub->write(frame);
+    }
+}
+
+void EventBus::publishMessage(const QVector<int>& userIds, const QByteArray& textEvent, const QByteArray& binaryEvent)
+{
+    QByteArray message = frame(MessageFrame, instanceId, [&](QDataStream& out) {
+        out << userIds << textEvent << binaryEvent;
+    });
+    QMetaObject::invokeMethod(this, [this, message]() { send(message); }, Qt::QueuedConnection);
+}
+
+void EventBus::publishUser(const QString& login, int userId)
+{
+    QByteArray user = frame(UserFrame, instanceId, [&](QDataStream& out) {
+        out << login << qint32(userId);
+    });
+    QMetaObject::invokeMethod(this, [this, user]() { send(user); }, Qt::QueuedConnection);
+}
+
+void EventBus::setPresence(int userId, bool online)
+{
+    QMetaObject::invokeMethod(this, [this, userId, online]() {
+        if (online)
+        {
+            localUsers.insert(userId);
+        }
+        else
+        {
+            localUsers.remove(userId);
+        }
+        send(frame(PresenceFrame, instanceId, [&](QDataStream& out) { out << qint32(userId) << online; }));
+    }, Qt::QueuedConnection);
+}
+
+bool EventBus::anyOnlineElsewhere(const QVector<int>& userIds) const
+{
+    QMutexLocker locker(&mutex);
+    for (int userId : userIds)
+    {
+        if (remoteCount.contains(userId))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+int EventBus::instanceCount() const
+{
+    QMutexLocker locker(&mutex);
+    return remoteUsers.size();
+}
+
+QByteArray EventBus::snapshot(const QString& instance, const QSet<int>& users) const
+{
+    return frame(SnapshotFrame, instance, [&](QDataStream& out) { out << users; });
+}
+
+void EventBus::setRemoteUsers(const QString& instance, const QSet<int>& users)
+{
+    QMutexLocker locker(&mutex);
+    QSet<int>& current = remoteUsers[instance];
+    for (int userId : current)
+    {
+        if (--remoteCount[userId] == 0)
+        {
+            remoteCount.remove(userId);
+        }
+    }
+    current = users;
+    for (int userId : current)
+    {
+        ++remoteCount[userId];
+    }
+}
+
+void EventBus::setRemoteUser(const QString& instance, int userId, bool online)
+{
+    QMutexLocker locker(&mutex);
+    QSet<int>& current = remoteUsers[instance];
+    if (online && !current.contains(userId))
+    {
+        current.insert(userId);
+        ++remoteCount[userId];
+    }
+    else if (!online && current.remove(userId) && --remoteCount[userId] == 0)
+    {
+        remoteCount.remove(userId);
+    }
+}
+
+void EventBus::clearRemoteUsers()
+{
+    QMutexLocker locker(&mutex);
+    remoteUsers.clear();
+    remoteCount.clear();
+}
@@ -0,0 +1,99 @@
+#ifndef EVENTBUS_H
+#define EVENTBUS_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QHash>
+#include <QSet>
+#include <QVector>
+#include <QMutex>
+#include <functional>
+
+class QLocalServer;
+class QLocalSocket;
+class QLockFile;
+class QTimer;
+
+// Шина событий между процессами сервера на одной машине (см. --reuse-port).
+// Процессы слушают один TCP-порт, и участники чата могут оказаться
+// подключены к разным процессам, поэтому new_message, регистрации и
+// присутствие пользователей расходятся по шине.
+//
+// Шина - звезда на Unix-сокете (QLocalServer). Концентратором становится
+// процесс, захвативший файл блокировки <name>.lock; остальные подключаются
+// к нему, и он пересылает каждый кадр всем, кроме отправителя. Если
+// концентратор завершился, блокировку забирает один из оставшихся, а
+// остальные переподключаются к нему. События, опубликованные во время
+// переподключения, теряются; присутствие восстанавливается полным снимком.
+//
+// Кадр: uint32 длина (big-endian) | QDataStream: uint8 тип, id процесса, поля.
+// Живёт в потоке Server; publish*, setPresence и anyOnlineElsewhere можно
+// вызывать из любого потока.
+class EventBus : public QObject {
+    Q_OBJECT
+
+public:
+    typedef std::function<void(const QVector<int>& userIds, const QByteArray& textEvent,
+                               const QByteArray& binaryEvent)> MessageHandler;
+    typedef std::function<void(const QString& login, int userId)> UserHandler;
+
+    EventBus(const QString& name, MessageHandler onMessage, UserHandler onUser, QObject *parent = nullptr);
+    ~EventBus();
+    void start();
+
+    // Событие new_message для пользователей userIds на других процессах.
+    void publishMessage(const QVector<int>& userIds, const QByteArray& textEvent, const QByteArray& binaryEvent);
+    // Новый пользователь: другие процессы обновляют кэш логинов и индекс поиска.
+    void publishUser(const QString& login, int userId);
+    // Первое подключение пользователя к этому процессу или разрыв последнего.
+    void setPresence(int userId, bool online);
+    // Подключён ли кто-то из userIds к другим процессам.
+    bool anyOnlineElsewhere(const QVector<int>& userIds) const;
+    int instanceCount() const; // Другие процессы, известные шине
+
+private:
+    enum FrameType : quint8
+    {
+        MessageFrame = 1,
+        UserFrame,
+        PresenceFrame,
+        SnapshotFrame, // Полный список пользователей процесса
+        GoneFrame      // Процесс отключился от концентратора
+    };
+
+    void connectToBus();
+    void scheduleRetry();
+    void onPeerConnected();
+    void onHubLost();
+    void readFrames(QLocalSocket* socket);
+    void handleFrame(QLocalSocket* from, const QByteArray& frame);
+    void dropPeer(QLocalSocket* peer);
+    void send(const QByteArray& frame, QLocalSocket* except = nullptr);
+    QByteArray snapshot(const QString& instance, const QSet<int>& users) const;
+    void setRemoteUsers(const QString& instance, const QSet<int>& users);
+    void setRemoteUser(const QString& instance, int userId, bool online);
+    void clearRemoteUsers();
+
+    template <typename Body>
+    QByteArray frame(FrameType type, const QString& origin, Body body) const;
+
+    QString name;
+    QString instanceId;
+    MessageHandler onMessage;
+    UserHandler onUser;
+    QLockFile* hubLock;
+    QLocalServer* server = nullptr;   // Если этот процесс - концентратор
+    QLocalSocket* hub = nullptr;      // Иначе подключение к концентратору
+    QHash<QLocalSocket*, QString> peers; // Концентратор: подключение -> id процесса
+    QHash<QLocalSocket*, QByteArray> buffers;
+    QTimer* retryTimer;
+    QSet<int> localUsers;             // Только в потоке шины
+
+    mutable QMutex mutex;             // Присутствие на других процессах
+    QHash<QString, QSet<int>> remoteUsers;
+    QHash<int, int> remoteCount;      // user_id -> на скольких процессах в сети
+
+    static const int MaxFrameSize = 16 * 1024 * 1024;
+};
+
+#endif // EVENTBUS_H
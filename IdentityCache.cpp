@@ -0,0 +1,57 @@
+#include "IdentityCache.h"
+#include "Storage.h"
+#include <QDateTime>
+
+IdentityCache::IdentityCache(int capacity)
+    : idsByLogin(qMax(1, capacity)), missingLogins(qMax(1, capacity / 10)),
+      hitCount(0), missCount(0)
+{
+}
+
+IdentityCache::Lookup IdentityCache::lookup(const QString& login, int* userId)
+{
+    QMutexLocker locker(&mutex);
+    if (int* cached = idsByLogin.object(login))
+    {
+        *userId = *cached;
+        hitCount.fetch_add(1, std::memory_order_relaxed);
+        return Found;
+    }
+    if (qint64* expires = missingLogins.object(login))
+    {
+        if (*expires > QDateTime::currentMSecsSinceEpoch())
+        {
+            hitCount.fetch_add(1, std::memory_order_relaxed);
+            return Missing;
+        }
+        missingLogins.remove(login);
+    }
+    missCount.fetch_add(1, std::memory_order_relaxed);
+    return Unknown;
+}
+
+void IdentityCache::insert(const QString& login, int userId)
+{
+    QMutexLocker locker(&mutex);
+    missingLogins.remove(login);
+    idsByLogin.insert(login, new int(userId));
+}
+
+void IdentityCache::insertMissing(const QString& login)
+{
+    QMutexLocker locker(&mutex);
+    missingLogins.insert(login, new qint64(QDateTime::currentMSecsSinceEpoch() + missingTtlMs));
+}
+
+int IdentityCache::warmUp(Storage* storage)
+{
+    return storage->forEachUser(idsByLogin.maxCost(), [this](const QString& login, int userId) {
+        insert(login, userId);
+    });
+}
+
+int IdentityCache::size() const
+{
+    QMutexLocker locker(&mutex);
+    return idsByLogin.size();
+}
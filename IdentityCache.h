@@ -0,0 +1,48 @@
+#ifndef IDENTITYCACHE_H
+#define IDENTITYCACHE_H
+
+#include <QCache>
+#include <QMutex>
+#include <QString>
+#include <atomic>
+
+class Storage;
+
+// Кэш соответствия login -> user_id в памяти процесса. Ограничен по числу
+// записей (LRU через QCache) и помнит отсутствующие логины, чтобы повторные
+// поиски несуществующих пользователей тоже не доходили до базы. Запись о
+// несуществующем логине живёт недолго: пользователя мог зарегистрировать
+// другой экземпляр сервера.
+class IdentityCache
+{
+public:
+    enum Lookup
+    {
+        Unknown, // В кэше ничего нет - нужен запрос к базе
+        Found,
+        Missing  // Известно, что такого логина нет
+    };
+
+    explicit IdentityCache(int capacity);
+
+    Lookup lookup(const QString& login, int* userId);
+    void insert(const QString& login, int userId);
+    void insertMissing(const QString& login);
+    // Заполняет кэш первыми capacity пользователями из хранилища.
+    int warmUp(Storage* storage);
+
+    quint64 hits() const { return hitCount.load(std::memory_order_relaxed); }
+    quint64 misses() const { return missCount.load(std::memory_order_relaxed); }
+    int size() const;
+
+private:
+    static const qint64 missingTtlMs = 30 * 1000;
+
+    mutable QMutex mutex;
+    QCache<QString, int> idsByLogin;
+    QCache<QString, qint64> missingLogins; // login -> момент устаревания записи
+    std::atomic<quint64> hitCount;
+    std::atomic<quint64> missCount;
+};
+
+#endif // IDENTITYCACHE_H
@@ -0,0 +1,180 @@
+#include "LogTail.h"
+#include <QFile>
+#include <QFileInfo>
+
+namespace
+{
+
+const int HeadSize = 64;
+
+// Делит [data, data + size) на строки по '\n'; последний фрагмент без '\n' не берётся.
+void splitLines(const char* data, qint64 size, qint64 base, QStringList* lines, QVector<qint64>* starts)
+{
+    qint64 start = 0;
+    for (qint64 i = 0; i < size; ++i)
+    {
+        if (data[i] == '\n')
+        {
+            qint64 end = i > start && data[i - 1] == '\r' ? i - 1 : i;
+            lines->append(QString::fromUtf8(data + start, int(end - start)));
+            starts->append(base + start);
+            start = i + 1;
+        }
+    }
+}
+
+} // namespace
+
+void LogTail::setPath(const QString& path)
+{
+    filePath = path;
+    offset = 0;
+    head.clear();
+}
+
+bool LogTail::replaced(qint64 size)
+{
+    if (size < offset)
+    {
+        return true; // Усечён или заменён более коротким
+    }
+    if (head.isEmpty())
+    {
+        return false;
+    }
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        return false;
+    }
+    return file.read(head.size()) != head;
+}
+
+void LogTail::rememberHead()
+{
+    QFile file(filePath);
+    if (file.open(QIODevice::ReadOnly))
+    {
+        head = file.read(HeadSize);
+    }
+}
+
+void LogTail::poll(QStringList* lines, QVector<qint64>* starts, bool* restarted)
+{
+    *restarted = false;
+    const qint64 size = QFileInfo(filePath).size();
+    if (replaced(size))
+    {
+        *restarted = true;
+        offset = 0;
+        head.clear();
+    }
+    if (size - offset > MaxBacklog)
+    {
+        // Окно всё равно покажет только последние строки
+        *restarted = true;
+        readTail(BacklogLines, lines, starts);
+        return;
+    }
+    if (size == offset)
+    {
+        return;
+    }
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly) || !file.seek(offset))
+    {
+        return;
+    }
+    const QByteArray chunk = file.read(qMin<qint64>(size - offset, MaxReadPerPoll));
+    int end = chunk.lastIndexOf('\n') + 1; // Неполную строку дочитаем в следующий раз
+    if (end == 0 && chunk.size() == MaxReadPerPoll)
+    {
+        // Строка длиннее MaxReadPerPoll: показываем её кусками, чтобы не застрять
+        lines->append(QString::fromUtf8(chunk));
+        starts->append(offset);
+        end = chunk.size();
+    }
+    splitLines(chunk.constData(), end, offset, lines, starts);
+    offset += end;
+    if (head.size() < HeadSize)
+    {
+        rememberHead();
+    }
+}
+
+void LogTail::readTail(int maxLines, QStringList* lines, QVector<qint64>* starts)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        offset = 0;
+        head.clear();
+        return;
+    }
+    const qint64 size = file.size();
+    // Конец последней полной строки
+    qint64 end = size;
+    const qint64 probe = qMin<qint64>(size, MaxReadPerPoll);
+    if (probe > 0)
+    {
+        file.seek(size - probe);
+        const QByteArray last = file.read(probe);
+        end = size - probe + last.lastIndexOf('\n') + 1;
+    }
+    file.close();
+    readBefore(end, maxLines, lines, starts);
+    offset = end;
+    rememberHead();
+}
+
+void LogTail::readBefore(qint64 before, int maxLines, QStringList* lines, QVector<qint64>* starts) const
+{
+    if (before <= 0 || maxLines <= 0)
+    {
+        return;
+    }
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        return;
+    }
+    // Окно отображения растёт назад, пока в нём не наберётся maxLines строк
+    qint64 window = 64 * 1024;
+    for (;;)
+    {
+        const qint64 start = qMax<qint64>(0, before - window);
+        const qint64 length = before - start;
+        uchar* mapped = file.map(start, length);
+        if (mapped == nullptr)
+        {
+            return;
+        }
+        const char* data = reinterpret_cast<const char*>(mapped);
+        // Строки с конца окна; самая ранняя может быть обрезана началом окна
+        int found = 0;
+        qint64 lineStart = length;
+        qint64 i = length - 1; // data[length - 1] - '\n' перед before
+        while (found < maxLines && i > 0)
+        {
+            --i;
+            if (data[i] == '\n')
+            {
+                lineStart = i + 1;
+                ++found;
+            }
+        }
+        const bool complete = found >= maxLines || start == 0 || window >= MaxScanWindow;
+        if (complete)
+        {
+            if (found < maxLines && start == 0)
+            {
+                lineStart = 0; // Первая строка файла
+            }
+            splitLines(data + lineStart, length - lineStart, start + lineStart, lines, starts);
+            file.unmap(mapped);
+            return;
+        }
+        file.unmap(mapped);
+        window *= 4;
+    }
+}
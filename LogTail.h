@@ -0,0 +1,44 @@
+#ifndef LOGTAIL_H
+#define LOGTAIL_H
+
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QVector>
+
+// Инкрементальное чтение растущего файла лога для окна сервера. Помнит
+// смещение и при каждом poll() читает только дописанные полные строки.
+// Ротацию (Logger переименовывает файл и начинает новый) и усечение
+// замечает по размеру файла и его первым байтам и начинает файл заново.
+// Более ранние строки для прокрутки назад читаются через QFile::map, не
+// загружая файл целиком. Каждая строка возвращается вместе со смещением
+// её начала в файле.
+class LogTail
+{
+public:
+    void setPath(const QString& path);
+    QString path() const { return filePath; }
+
+    // Новые строки с прошлого вызова. restarted - файл начат заново (ротация,
+    // усечение или слишком большой отрыв), и прежнее содержимое окна неактуально.
+    void poll(QStringList* lines, QVector<qint64>* starts, bool* restarted);
+    // Последние maxLines строк; следующий poll() продолжит после них.
+    void readTail(int maxLines, QStringList* lines, QVector<qint64>* starts);
+    // До maxLines строк, заканчивающихся перед смещением before (началом строки).
+    void readBefore(qint64 before, int maxLines, QStringList* lines, QVector<qint64>* starts) const;
+
+    static const int MaxReadPerPoll = 1024 * 1024;
+    static const int MaxBacklog = 8 * 1024 * 1024; // Больше - показываем только хвост
+    static const int BacklogLines = 1000;
+    static const int MaxScanWindow = 4 * 1024 * 1024;
+
+private:
+    bool replaced(qint64 size);
+    void rememberHead();
+
+    QString filePath;
+    qint64 offset = 0;  // Начало ещё не прочитанной строки
+    QByteArray head;    // Первые байты файла: по ним видно, что файл заменён
+};
+
+#endif // LOGTAIL_H
@@ -1,8 +1,30 @@
 #include "Logger.h"
+#include <QElapsedTimer>
+
+// Поток-писатель просто крутит цикл Logger::writerLoop.
+class LogWriterThread : public QThread
+{
+public:
+    explicit LogWriterThread(Logger* logger) : logger(logger) {}
+
+protected:
+    void run() override { logger->writerLoop(); }
+
+private:
+    Logger* logger;
+};
 
 Logger* Logger::instance = nullptr;
 
-Logger::Logger() { setLogFile(QDir::homePath() + "/default_log.txt"); }
+Logger::Logger() : queue(16384), running(true), dropped(0)
+{
+    // Файл по умолчанию откроется только при первой записи: обычно до неё
+    // main успевает назначить свой через setLogFile (опция --log)
+    logPath = QDir::homePath() + "/default_log.txt";
+    pendingPath = logPath;
+    writer = new LogWriterThread(this);
+    writer->start(QThread::LowPriority);
+}
 
 Logger* Logger::getInstance()
 {
@@ -15,26 +37,207 @@ Logger* Logger::getInstance()
 
 void Logger::logToFile(const QString &message)
 {
-    if (logFile.isOpen())
+    if (!running.load(std::memory_order_acquire))
+    {
+        qDebug() << "Logger is stopped. Message: " << message;
+        return;
+    }
+    Record record;
+    record.timestamp = QDateTime::currentMSecsSinceEpoch(); // Форматирование времени - в потоке-писателе
+    record.message = message;
+    if (!queue.tryPush(std::move(record)))
     {
-        QTextStream stream(&logFile);
-        QString timeStamp = QDateTime::currentDateTime().toString("yyyy-MM-dd hh:mm:ss");
-        stream << timeStamp << " " << message << "\n"; // Добавляем временную метку к сообщению
-    } else
+        // Писатель не успевает: не блокируем вызывающий поток, а считаем потерю
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    if (queue.approximateSize() >= queue.capacity() / 4)
     {
-        qDebug() << "LogFile is not open. Message: " << message;
+        wakeCondition.wakeOne();
     }
 }
 
 void Logger::setLogFile(const QString &filename)
 {
+    {
+        QMutexLocker locker(&pathMutex);
+        logPath = filename;
+        pendingPath = filename; // Файл переоткроет поток-писатель
+    }
+    wakeCondition.wakeOne();
+}
+
+QString Logger::logFilePath() const
+{
+    QMutexLocker locker(&pathMutex);
+    return logPath;
+}
+
+void Logger::setRotation(qint64 maxFileSize, int maxFiles)
+{
+    QMutexLocker locker(&pathMutex);
+    this->maxFileSize = maxFileSize;
+    this->maxFiles = maxFiles;
+}
+
+quint64 Logger::droppedCount() const
+{
+    return dropped.load(std::memory_order_relaxed);
+}
+
+void Logger::shutdown()
+{
+    if (writer == nullptr)
+    {
+        return;
+    }
+    running.store(false, std::memory_order_release);
+    wakeCondition.wakeAll();
+    writer->wait();
+    delete writer;
+    writer = nullptr;
     if (logFile.isOpen())
     {
         logFile.close();
     }
-    logFile.setFileName(filename);
+}
+
+void Logger::writerLoop()
+{
+    QByteArray batch;
+    QElapsedTimer sinceFlush;
+    sinceFlush.start();
+    Record record;
+    for (;;)
+    {
+        bool stopping = !running.load(std::memory_order_acquire);
+
+        int drained = 0;
+        while (drained < 4096 && queue.tryPop(record))
+        {
+            appendRecord(batch, record);
+            ++drained;
+        }
+
+        quint64 droppedNow = dropped.load(std::memory_order_relaxed);
+        if (droppedNow != reportedDropped)
+        {
+            Record report;
+            report.timestamp = QDateTime::currentMSecsSinceEpoch();
+            report.message = QString("Logger dropped %1 records (%2 total)")
+                .arg(droppedNow - reportedDropped)
+                .arg(droppedNow);
+            appendRecord(batch, report);
+            reportedDropped = droppedNow;
+        }
+
+        if (!batch.isEmpty() && (batch.size() >= flushBytes || sinceFlush.elapsed() >= flushIntervalMs || stopping))
+        {
+            openPendingFile();
+            writeBatch(batch);
+            sinceFlush.restart();
+        }
+
+        if (stopping && drained == 0)
+        {
+            break;
+        }
+        if (drained == 0)
+        {
+            QMutexLocker locker(&wakeMutex);
+            wakeCondition.wait(&wakeMutex, flushIntervalMs);
+        }
+    }
+}
+
+void Logger::openPendingFile()
+{
+    QString path;
+    {
+        QMutexLocker locker(&pathMutex);
+        if (pendingPath.isEmpty())
+        {
+            return;
+        }
+        path = pendingPath;
+        pendingPath.clear();
+    }
+    if (logFile.isOpen())
+    {
+        logFile.close();
+    }
+    logFile.setFileName(path);
+    if(!logFile.open(QFile::WriteOnly | QFile::Append))
+    {
+        qDebug() << "Failed to open log file:" << path;
+    }
+}
+
+void Logger::appendRecord(QByteArray& batch, const Record& record)
+{
+    // Временная метка форматируется не чаще раза в секунду
+    qint64 second = record.timestamp / 1000;
+    if (second != cachedSecond)
+    {
+        cachedSecond = second;
+        cachedTimeStamp = QDateTime::fromMSecsSinceEpoch(record.timestamp)
+            .toString("yyyy-MM-dd hh:mm:ss").toUtf8();
+    }
+    batch += cachedTimeStamp;
+    batch += ' ';
+    batch += record.message.toUtf8();
+    batch += '\n';
+}
+
+void Logger::writeBatch(QByteArray& batch)
+{
+    if (!logFile.isOpen())
+    {
+        qDebug() << "LogFile is not open. Messages: " << batch;
+        batch.clear();
+        return;
+    }
+    logFile.write(batch);
+    logFile.flush();
+    batch.clear();
+
+    qint64 limit;
+    {
+        QMutexLocker locker(&pathMutex);
+        limit = maxFileSize;
+    }
+    if (limit > 0 && logFile.size() >= limit)
+    {
+        rotate();
+    }
+}
+
+void Logger::rotate()
+{
+    // log.txt -> log.txt.1 -> log.txt.2 ... старейший архив удаляется
+    int keep;
+    {
+        QMutexLocker locker(&pathMutex);
+        keep = maxFiles;
+    }
+    QString path = logFile.fileName();
+    logFile.close();
+    if (keep > 0)
+    {
+        QFile::remove(path + "." + QString::number(keep));
+        for (int i = keep - 1; i >= 1; --i)
+        {
+            QFile::rename(path + "." + QString::number(i), path + "." + QString::number(i + 1));
+        }
+        QFile::rename(path, path + ".1");
+    }
+    else
+    {
+        QFile::remove(path);
+    }
+    logFile.setFileName(path);
     if(!logFile.open(QFile::WriteOnly | QFile::Append))
     {
-        qDebug() << "Failed to open log file:" << filename;
+        qDebug() << "Failed to reopen log file after rotation:" << path;
     }
 }
@@ -7,18 +7,67 @@
 #include <QTextStream>
 #include <QDir>
 #include <QDateTime>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QThread>
+#include <atomic>
+#include "MpscQueue.h"
 
+// Асинхронный логгер. logToFile только кладёт запись в ограниченную очередь
+// и сразу возвращается; форматирование, запись на диск и ротацию файлов
+// выполняет отдельный поток-писатель. Если очередь переполнена, запись
+// отбрасывается и учитывается в счётчике droppedCount().
 class Logger
 {
 private:
+    struct Record
+    {
+        qint64 timestamp = 0;
+        QString message;
+    };
+
     static Logger* instance;
     QFile logFile;
     Logger();
 
+    MpscQueue<Record> queue;
+    QThread* writer = nullptr;
+    std::atomic<bool> running;
+    std::atomic<quint64> dropped;
+    quint64 reportedDropped = 0;
+
+    QMutex wakeMutex;
+    QWaitCondition wakeCondition;
+
+    mutable QMutex pathMutex;
+    QString logPath;
+    QString pendingPath;
+
+    qint64 maxFileSize = 10 * 1024 * 1024;
+    int maxFiles = 5;
+    static const int flushBytes = 64 * 1024;
+    static const int flushIntervalMs = 200;
+
+    qint64 cachedSecond = -1;
+    QByteArray cachedTimeStamp;
+
+    void writerLoop();
+    void openPendingFile();
+    void appendRecord(QByteArray& batch, const Record& record);
+    void writeBatch(QByteArray& batch);
+    void rotate();
+
+    friend class LogWriterThread;
+
 public:
     static Logger* getInstance();
     void logToFile(const QString &message);
     void setLogFile(const QString &filename);
+    QString logFilePath() const;
+    void setRotation(qint64 maxFileSize, int maxFiles);
+    quint64 droppedCount() const;
+    // Дописывает всё, что осталось в очереди, и останавливает поток-писатель.
+    void shutdown();
 };
 
 #endif // LOGGER_H
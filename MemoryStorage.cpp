@@ -0,0 +1,257 @@
+#include "MemoryStorage.h"
+#include <QDebug>
+#include <algorithm>
+
+namespace
+{
+
+bool lessThanId(const ChatMessage& message, int messageId)
+{
+    return message.messageId < messageId;
+}
+
+bool idLessThan(int messageId, const ChatMessage& message)
+{
+    return messageId < message.messageId;
+}
+
+} // namespace
+
+MemoryStorage::Chat* MemoryStorage::findChat(int chatId)
+{
+    return chatId >= 1 && chatId <= chats.size() ? &chats[chatId - 1] : nullptr;
+}
+
+int MemoryStorage::findUser(const QString& login, bool* ok)
+{
+    *ok = true;
+    QReadLocker locker(&lock);
+    return idsByLogin.value(login, -1);
+}
+
+int MemoryStorage::addUser(const QString& login, const QString& passwordHash)
+{
+    QWriteLocker locker(&lock);
+    if (idsByLogin.contains(login))
+    {
+        qCritical() << "Failed to add user to database: login" << login << "is taken";
+        return -1;
+    }
+    User user;
+    user.login = login;
+    user.password = passwordHash;
+    users.append(user);
+    idsByLogin.insert(login, users.size());
+    return users.size();
+}
+
+int MemoryStorage::findCredentials(const QString& login, QString* storedPassword)
+{
+    QReadLocker locker(&lock);
+    const int userId = idsByLogin.value(login, -1);
+    if (userId != -1)
+    {
+        *storedPassword = users.at(userId - 1).password;
+    }
+    return userId;
+}
+
+bool MemoryStorage::updatePasswordHash(int userId, const QString& passwordHash)
+{
+    QWriteLocker locker(&lock);
+    if (userId < 1 || userId > users.size())
+    {
+        return false;
+    }
+    users[userId - 1].password = passwordHash;
+    return true;
+}
+
+int MemoryStorage::forEachUser(int limit, const UserVisitor& visit)
+{
+    QReadLocker locker(&lock);
+    const int count = limit < 0 ? users.size() : qMin(limit, users.size());
+    for (int i = 0; i < count; ++i)
+    {
+        visit(users.at(i).login, i + 1);
+    }
+    return count;
+}
+
+int MemoryStorage::createChat(const QString& chatName, const QString& chatType)
+{
+    Q_UNUSED(chatName);
+    Q_UNUSED(chatType);
+    QWriteLocker locker(&lock);
+    chats.append(Chat());
+    return chats.size();
+}
+
+bool MemoryStorage::addParticipant(int chatId, int userId)
+{
+    QWriteLocker locker(&lock);
+    Chat* chat = findChat(chatId);
+    if (chat == nullptr || chat->participants.contains(userId))
+    {
+        qCritical() << "Failed to add user to chat:" << userId << "to" << chatId;
+        return false;
+    }
+    chat->participants.append(userId);
+    chat->markers.insert(userId, ReadMarker());
+    chatsByUser[userId].append(chatId);
+    return true;
+}
+
+bool MemoryStorage::chatExistsBetween(int userId1, int userId2)
+{
+    QReadLocker locker(&lock);
+    for (int chatId : chatsByUser.value(userId1))
+    {
+        if (chats.at(chatId - 1).participants.contains(userId2))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+QVector<int> MemoryStorage::chatParticipants(int chatId)
+{
+    QReadLocker locker(&lock);
+    return chatId >= 1 && chatId <= chats.size() ? chats.at(chatId - 1).participants : QVector<int>();
+}
+
+QList<ChatListItem> MemoryStorage::chatsForUser(int userId)
+{
+    QList<ChatListItem> items;
+    QReadLocker locker(&lock);
+    for (int chatId : chatsByUser.value(userId))
+    {
+        const Chat& chat = chats.at(chatId - 1);
+        for (int peerId : chat.participants)
+        {
+            if (peerId == userId || peerId < 1 || peerId > users.size())
+            {
+                continue;
+            }
+            ChatListItem item;
+            item.chatId = chatId;
+            item.peerLogin = users.at(peerId - 1).login;
+            item.unreadCount = chat.markers.value(userId).unreadCount;
+            if (!chat.messages.isEmpty())
+            {
+                item.lastMessage = chat.messages.last();
+            }
+            items.append(item);
+        }
+    }
+    locker.unlock();
+    std::sort(items.begin(), items.end(), [](const ChatListItem& a, const ChatListItem& b) {
+        if (a.lastMessage.messageId != b.lastMessage.messageId)
+        {
+            return a.lastMessage.messageId > b.lastMessage.messageId;
+        }
+        return a.chatId > b.chatId;
+    });
+    return items;
+}
+
+bool MemoryStorage::markRead(int chatId, int userId, int messageId)
+{
+    QWriteLocker locker(&lock);
+    Chat* chat = findChat(chatId);
+    if (chat == nullptr || !chat->markers.contains(userId))
+    {
+        return false;
+    }
+    ReadMarker& marker = chat->markers[userId];
+    if (marker.lastReadMessageId < messageId)
+    {
+        marker.lastReadMessageId = messageId;
+        marker.unreadCount = 0;
+        auto it = std::upper_bound(chat->messages.constBegin(), chat->messages.constEnd(), messageId, idLessThan);
+        for (; it != chat->messages.constEnd(); ++it)
+        {
+            if (it->senderId != userId)
+            {
+                ++marker.unreadCount;
+            }
+        }
+    }
+    return true;
+}
+
+MessagePage MemoryStorage::loadMessagePage(const MessageCursor& cursor, bool* ok)
+{
+    *ok = true;
+    MessagePage page;
+    QReadLocker locker(&lock);
+    if (cursor.chatId < 1 || cursor.chatId > chats.size())
+    {
+        return page;
+    }
+    const QVector<ChatMessage>& messages = chats.at(cursor.chatId - 1).messages;
+    int from = 0;
+    int to = messages.size();
+    switch (cursor.direction)
+    {
+    case MessageCursor::Latest:
+        from = qMax(0, to - cursor.limit);
+        page.hasMore = from > 0;
+        break;
+    case MessageCursor::Before:
+        to = int(std::lower_bound(messages.constBegin(), messages.constEnd(), cursor.messageId, lessThanId)
+                 - messages.constBegin());
+        from = qMax(0, to - cursor.limit);
+        page.hasMore = from > 0;
+        break;
+    case MessageCursor::After:
+        from = int(std::upper_bound(messages.constBegin(), messages.constEnd(), cursor.messageId, idLessThan)
+                   - messages.constBegin());
+        to = qMin(messages.size(), from + cursor.limit);
+        page.hasMore = to < messages.size();
+        break;
+    }
+    for (int i = from; i < to; ++i)
+    {
+        page.messages.append(messages.at(i));
+    }
+    return page;
+}
+
+void MemoryStorage::appendMessages(const QVector<NewMessage>& batch, const QDateTime& sentAt,
+                                   QVector<StoredMessage>* results)
+{
+    results->resize(batch.size());
+    QWriteLocker locker(&lock);
+    for (int i = 0; i < batch.size(); ++i)
+    {
+        const NewMessage& pending = batch.at(i);
+        Chat* chat = findChat(pending.chatId);
+        if (chat == nullptr)
+        {
+            (*results)[i].error = "chat does not exist";
+            continue;
+        }
+        ChatMessage message;
+        message.messageId = ++lastMessageId;
+        message.senderId = pending.userId;
+        message.timestamp = sentAt.toSecsSinceEpoch();
+        message.text = pending.text;
+        chat->messages.append(message);
+        // Непрочитанные у остальных участников растут, отправитель своё прочитал
+        for (auto it = chat->markers.begin(); it != chat->markers.end(); ++it)
+        {
+            if (it.key() == pending.userId)
+            {
+                it->lastReadMessageId = message.messageId;
+                it->unreadCount = 0;
+            }
+            else
+            {
+                ++it->unreadCount;
+            }
+        }
+        (*results)[i].messageId = message.messageId;
+    }
+}
@@ -0,0 +1,67 @@
+#ifndef MEMORYSTORAGE_H
+#define MEMORYSTORAGE_H
+
+#include <QHash>
+#include <QReadWriteLock>
+#include <QVector>
+#include "Storage.h"
+
+// Хранилище целиком в памяти процесса, без диска и SQL. Нужно для
+// нагрузочных прогонов: показывает потолок пропускной способности сервера
+// без базы. Данные живут до завершения процесса и не видны другим
+// процессам, поэтому с --reuse-port не используется.
+// Чтения идут параллельно под общей блокировкой, записи - под исключительной.
+class MemoryStorage : public Storage
+{
+public:
+    bool open() override { return true; }
+    QString description() const override { return "in-memory storage"; }
+
+    int findUser(const QString& login, bool* ok) override;
+    int addUser(const QString& login, const QString& passwordHash) override;
+    int findCredentials(const QString& login, QString* storedPassword) override;
+    bool updatePasswordHash(int userId, const QString& passwordHash) override;
+    int forEachUser(int limit, const UserVisitor& visit) override;
+
+    int createChat(const QString& chatName, const QString& chatType) override;
+    bool addParticipant(int chatId, int userId) override;
+    bool chatExistsBetween(int userId1, int userId2) override;
+    QVector<int> chatParticipants(int chatId) override;
+    QList<ChatListItem> chatsForUser(int userId) override;
+    bool markRead(int chatId, int userId, int messageId) override;
+
+    MessagePage loadMessagePage(const MessageCursor& cursor, bool* ok) override;
+    void appendMessages(const QVector<NewMessage>& batch, const QDateTime& sentAt,
+                        QVector<StoredMessage>* results) override;
+
+private:
+    struct User
+    {
+        QString login;
+        QString password;
+    };
+
+    struct ReadMarker
+    {
+        int lastReadMessageId = 0;
+        int unreadCount = 0;
+    };
+
+    struct Chat
+    {
+        QVector<int> participants;
+        QHash<int, ReadMarker> markers;  // user_id -> отметка
+        QVector<ChatMessage> messages;   // По возрастанию message_id
+    };
+
+    Chat* findChat(int chatId);
+
+    mutable QReadWriteLock lock;
+    QVector<User> users;                 // user_id = индекс + 1
+    QHash<QString, int> idsByLogin;
+    QVector<Chat> chats;                 // chat_id = индекс + 1
+    QHash<int, QVector<int>> chatsByUser;
+    int lastMessageId = 0;
+};
+
+#endif // MEMORYSTORAGE_H
@@ -0,0 +1,176 @@
+#include "MessageWriter.h"
+#include "Storage.h"
+#include "Metrics.h"
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QDebug>
+
+// Поток записи сообщений со своим соединением с хранилищем.
+class MessageWriterThread : public QThread
+{
+public:
+    explicit MessageWriterThread(MessageWriter* writer) : writer(writer) {}
+
+protected:
+    void run() override
+    {
+        writer->storage->attachThread();
+        writer->writerLoop();
+        writer->storage->releaseThread();
+    }
+
+private:
+    MessageWriter* writer;
+};
+
+MessageWriter::MessageWriter(Storage* storage, int maxBatch, int maxDelayMs, int capacity,
+                             ParticipantsLookup participants, CommittedHandler committed)
+    : storage(storage), maxBatch(qMax(1, maxBatch)), maxDelayMs(qMax(0, maxDelayMs)), capacity(qMax(1, capacity)),
+      participants(participants), committed(committed), messages(0), batches(0)
+{
+    thread = new MessageWriterThread(this);
+    thread->setObjectName("message-writer");
+    thread->start();
+}
+
+MessageWriter::~MessageWriter()
+{
+    {
+        QMutexLocker locker(&mutex);
+        stopping = true; // Принятые сообщения всё равно будут записаны
+    }
+    notEmpty.wakeAll();
+    thread->wait();
+    delete thread;
+}
+
+bool MessageWriter::submit(const std::shared_ptr<ResultGuard>& guard, int chatId, int userId, const QString& text, Done done)
+{
+    Pending pending;
+    pending.message.chatId = chatId;
+    pending.message.userId = userId;
+    pending.message.text = text;
+    pending.guard = guard;
+    pending.done = done;
+    {
+        QMutexLocker locker(&mutex);
+        if (stopping || queue.size() >= capacity)
+        {
+            return false;
+        }
+        queue.append(pending);
+    }
+    notEmpty.wakeOne();
+    return true;
+}
+
+int MessageWriter::queueDepth() const
+{
+    QMutexLocker locker(&mutex);
+    return queue.size();
+}
+
+void MessageWriter::writerLoop()
+{
+    for (;;)
+    {
+        QVector<Pending> batch;
+        {
+            QMutexLocker locker(&mutex);
+            while (queue.isEmpty() && !stopping)
+            {
+                notEmpty.wait(&mutex);
+            }
+            if (queue.isEmpty())
+            {
+                return; // stopping и всё записано
+            }
+            // Добираем партию, но не дольше maxDelayMs с первого сообщения
+            QElapsedTimer sinceFirst;
+            sinceFirst.start();
+            while (queue.size() < maxBatch && !stopping)
+            {
+                qint64 left = maxDelayMs - sinceFirst.elapsed();
+                if (left <= 0)
+                {
+                    break;
+                }
+                notEmpty.wait(&mutex, static_cast<unsigned long>(left));
+            }
+            const int taken = qMin(queue.size(), maxBatch);
+            batch = queue.mid(0, taken);
+            queue.remove(0, taken);
+        }
+        commitBatch(batch);
+    }
+}
+
+void MessageWriter::commitBatch(QVector<Pending>& batch)
+{
+    // Участников каждого чата читаем один раз на партию и до записи:
+    // писать в чат может только его участник
+    QHash<int, QVector<int>> participantsByChat;
+    QVector<StoredMessage> results(batch.size());
+    QVector<NewMessage> messagesToStore;
+    QVector<int> storedIndexes;
+    messagesToStore.reserve(batch.size());
+    storedIndexes.reserve(batch.size());
+    for (int i = 0; i < batch.size(); ++i)
+    {
+        const NewMessage& message = batch.at(i).message;
+        if (participants)
+        {
+            if (!participantsByChat.contains(message.chatId))
+            {
+                participantsByChat.insert(message.chatId, participants(message.chatId));
+            }
+            if (!participantsByChat.value(message.chatId).contains(message.userId))
+            {
+                results[i].error = "not a participant";
+                continue;
+            }
+        }
+        messagesToStore.append(message);
+        storedIndexes.append(i);
+    }
+
+    // Время отправки проставляем сами, чтобы кэш последних сообщений
+    // хранил то же значение, что и база
+    const QDateTime sentAt = QDateTime::currentDateTimeUtc();
+    if (!messagesToStore.isEmpty())
+    {
+        QVector<StoredMessage> written;
+        const quint64 sqlStart = Metrics::nowMicros();
+        storage->appendMessages(messagesToStore, sentAt, &written);
+        Metrics::recordSql(Metrics::SqlMessageBatch, Metrics::nowMicros() - sqlStart);
+        for (int j = 0; j < storedIndexes.size(); ++j)
+        {
+            results[storedIndexes.at(j)] = written.at(j);
+        }
+    }
+
+    int stored = 0;
+    for (int i = 0; i < batch.size(); ++i)
+    {
+        if (results.at(i).error.isEmpty())
+        {
+            const int chatId = batch.at(i).message.chatId;
+            results[i].participants = participantsByChat.value(chatId);
+            ++stored;
+            if (committed)
+            {
+                ChatMessage message;
+                message.messageId = results.at(i).messageId;
+                message.senderId = batch.at(i).message.userId;
+                message.timestamp = sentAt.toSecsSinceEpoch();
+                message.text = batch.at(i).message.text;
+                committed(chatId, message);
+            }
+        }
+        const Done done = batch.at(i).done;
+        const StoredMessage result = results.at(i);
+        batch.at(i).guard->post([done, result]() { done(result); });
+    }
+    messages.fetch_add(stored, std::memory_order_relaxed);
+    batches.fetch_add(1, std::memory_order_relaxed);
+}
@@ -0,0 +1,78 @@
+#ifndef MESSAGEWRITER_H
+#define MESSAGEWRITER_H
+
+#include <QMutex>
+#include <QWaitCondition>
+#include <QThread>
+#include <QVector>
+#include <QHash>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include "DbExecutor.h"
+#include "Models.h"
+
+class Storage;
+
+// Групповая запись send_message. Сообщения копятся в очереди и
+// записываются одной транзакцией: партия закрывается, когда набралось
+// maxBatch сообщений или прошло maxDelayMs с прихода первого из них.
+// Подтверждение (done) отправляется только после COMMIT, т.е. когда
+// партия уже на диске; один fsync приходится на всю партию.
+// Саму запись делает Storage::appendMessages: в той же транзакции
+// обновляются сводки чатов и счётчики непрочитанных, из которых
+// собирается get_chats. Перед записью партии проверяется, что отправитель
+// каждого сообщения - участник чата (по ParticipantsLookup); остальные
+// сообщения отклоняются с ошибкой "not a participant".
+class MessageWriter
+{
+public:
+    // Пустая функция - участников не проверять и не рассылать (бенчмарк).
+    typedef std::function<QVector<int>(int chatId)> ParticipantsLookup;
+    typedef std::function<void(const StoredMessage&)> Done;
+    // Вызывается в потоке записи для каждого сохранённого сообщения
+    // после COMMIT и до отправки подтверждений.
+    typedef std::function<void(int chatId, const ChatMessage& message)> CommittedHandler;
+
+    MessageWriter(Storage* storage, int maxBatch, int maxDelayMs, int capacity, ParticipantsLookup participants,
+                  CommittedHandler committed = CommittedHandler());
+    ~MessageWriter();
+
+    // false - очередь переполнена, сообщение не принято.
+    bool submit(const std::shared_ptr<ResultGuard>& guard, int chatId, int userId, const QString& text, Done done);
+
+    int queueDepth() const;
+    quint64 committedMessages() const { return messages.load(std::memory_order_relaxed); }
+    quint64 committedBatches() const { return batches.load(std::memory_order_relaxed); }
+
+private:
+    struct Pending
+    {
+        NewMessage message;
+        std::shared_ptr<ResultGuard> guard;
+        Done done;
+    };
+
+    void writerLoop();
+    void commitBatch(QVector<Pending>& batch);
+
+    Storage* storage;
+    const int maxBatch;
+    const int maxDelayMs;
+    const int capacity;
+    ParticipantsLookup participants;
+    CommittedHandler committed;
+
+    mutable QMutex mutex;
+    QWaitCondition notEmpty;
+    QVector<Pending> queue;
+    bool stopping = false;
+    QThread* thread = nullptr;
+
+    std::atomic<quint64> messages;
+    std::atomic<quint64> batches;
+
+    friend class MessageWriterThread;
+};
+
+#endif // MESSAGEWRITER_H
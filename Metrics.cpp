@@ -0,0 +1,185 @@
+#include "Metrics.h"
+#include <QtAlgorithms>
+#include <chrono>
+#include <cmath>
+
+namespace
+{
+
+const char* const sqlSiteNames[Metrics::SqlSiteCount] = {
+    "is_login_free",
+    "add_user",
+    "authenticate",
+    "create_chat",
+    "add_user_to_chat",
+    "find_user_id",
+    "chat_exists",
+    "get_chats",
+    "mark_read",
+    "load_message_page",
+    "chat_participants",
+    "message_batch",
+    "update_password",
+};
+
+int bucketFor(quint64 micros)
+{
+    if (micros < quint64(Metrics::SubBuckets))
+    {
+        return int(micros); // Малые значения - точно, по корзине на микросекунду
+    }
+    const int msb = 63 - int(qCountLeadingZeroBits(micros));
+    const int sub = int((micros >> (msb - Metrics::SubBucketBits)) & (Metrics::SubBuckets - 1));
+    return qMin((msb - Metrics::SubBucketBits + 1) * Metrics::SubBuckets + sub, Metrics::BucketCount - 1);
+}
+
+// Середина диапазона значений корзины.
+double bucketMidpoint(int index)
+{
+    if (index < Metrics::SubBuckets)
+    {
+        return index;
+    }
+    const int shift = index / Metrics::SubBuckets - 1;
+    const quint64 lower = quint64(Metrics::SubBuckets + index % Metrics::SubBuckets) << shift;
+    return lower + (quint64(1) << shift) / 2.0;
+}
+
+} // namespace
+
+const char* Metrics::sqlSiteName(SqlSite site)
+{
+    return sqlSiteNames[site];
+}
+
+Metrics* Metrics::getInstance()
+{
+    static Metrics metrics;
+    return &metrics;
+}
+
+Metrics::Shard& Metrics::local()
+{
+    thread_local Shard* shard = nullptr;
+    if (shard == nullptr)
+    {
+        // Шарды не удаляются: после завершения потока его счётчики остаются в сумме
+        shard = new Shard();
+        Metrics* metrics = getInstance();
+        QMutexLocker locker(&metrics->mutex);
+        metrics->shards.append(shard);
+    }
+    return *shard;
+}
+
+quint64 Metrics::nowMicros()
+{
+    return quint64(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+void Metrics::Histogram::record(quint64 micros)
+{
+    buckets[bucketFor(micros)].add();
+    sum.add(micros);
+}
+
+void Metrics::HistogramSnapshot::add(const Histogram& histogram)
+{
+    for (int i = 0; i < BucketCount; ++i)
+    {
+        const quint64 value = histogram.buckets[i].load();
+        buckets[i] += value;
+        count += value;
+    }
+    sumMicros += histogram.sum.load();
+}
+
+void Metrics::HistogramSnapshot::subtract(const HistogramSnapshot& earlier)
+{
+    for (int i = 0; i < BucketCount; ++i)
+    {
+        buckets[i] -= earlier.buckets[i];
+    }
+    count -= earlier.count;
+    sumMicros -= earlier.sumMicros;
+}
+
+double Metrics::HistogramSnapshot::percentile(double quantile) const
+{
+    if (count == 0)
+    {
+        return 0;
+    }
+    const quint64 rank = qMax<quint64>(1, quint64(std::ceil(quantile * double(count))));
+    quint64 seen = 0;
+    for (int i = 0; i < BucketCount; ++i)
+    {
+        seen += buckets[i];
+        if (seen >= rank)
+        {
+            return bucketMidpoint(i);
+        }
+    }
+    return bucketMidpoint(BucketCount - 1);
+}
+
+void Metrics::recordCommand(Protocol::Command command, quint64 micros, quint64 bytesIn, quint64 bytesOut, bool failed)
+{
+    CommandStats& stats = local().commands[int(command)];
+    stats.count.add();
+    if (failed)
+    {
+        stats.errors.add();
+    }
+    stats.bytesIn.add(bytesIn);
+    stats.bytesOut.add(bytesOut);
+    stats.latency.record(micros);
+}
+
+void Metrics::recordUnknownCommand()
+{
+    local().unknownCommands.add();
+}
+
+void Metrics::recordSql(SqlSite site, quint64 micros)
+{
+    local().sql[site].record(micros);
+}
+
+void Metrics::recordConnection()
+{
+    local().connectionsAccepted.add();
+}
+
+void Metrics::recordBytesOut(quint64 bytes)
+{
+    local().bytesOut.add(bytes);
+}
+
+Metrics::Snapshot Metrics::snapshot() const
+{
+    Snapshot snapshot;
+    QMutexLocker locker(&mutex);
+    for (const Shard* shard : shards)
+    {
+        for (int i = 0; i < int(Protocol::Command::Count); ++i)
+        {
+            const CommandStats& stats = shard->commands[i];
+            CommandSnapshot& total = snapshot.commands[i];
+            total.count += stats.count.load();
+            total.errors += stats.errors.load();
+            total.bytesIn += stats.bytesIn.load();
+            total.bytesOut += stats.bytesOut.load();
+            total.latency.add(stats.latency);
+        }
+        for (int i = 0; i < SqlSiteCount; ++i)
+        {
+            snapshot.sql[i].add(shard->sql[i]);
+        }
+        snapshot.unknownCommands += shard->unknownCommands.load();
+        snapshot.connectionsAccepted += shard->connectionsAccepted.load();
+        snapshot.bytesOut += shard->bytesOut.load();
+    }
+    return snapshot;
+}
@@ -0,0 +1,147 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <QMutex>
+#include <QVector>
+#include <QtGlobal>
+#include <atomic>
+#include "Protocol.h"
+
+// Счётчики и гистограммы задержек сервера. У каждого потока свой шард:
+// пишет в него только поток-владелец (relaxed load + store, без блокировок
+// и без атомарных read-modify-write), а snapshot() складывает все шарды.
+// Шард создаётся при первой записи из потока и живёт до конца процесса,
+// поэтому данные завершившихся потоков не теряются.
+class Metrics
+{
+public:
+    // Места выполнения SQL, время которых учитывается отдельно.
+    enum SqlSite
+    {
+        SqlIsLoginFree,
+        SqlAddUser,
+        SqlAuthenticate,
+        SqlCreateChat,
+        SqlAddUserToChat,
+        SqlFindUserId,
+        SqlChatExists,
+        SqlGetChats,
+        SqlMarkRead,
+        SqlLoadMessagePage,
+        SqlChatParticipants,
+        SqlMessageBatch,
+        SqlUpdatePassword,
+        SqlSiteCount
+    };
+    static const char* sqlSiteName(SqlSite site);
+
+    // Счётчик одного потока-писателя; читать можно из любого потока.
+    class Counter
+    {
+    public:
+        void add(quint64 n = 1) { value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+        quint64 load() const { return value.load(std::memory_order_relaxed); }
+
+    private:
+        std::atomic<quint64> value{0};
+    };
+
+    // Лог-линейная гистограмма в микросекундах: 8 корзин на каждую степень
+    // двойки, погрешность перцентиля - не больше 12.5%.
+    static const int SubBucketBits = 3;
+    static const int SubBuckets = 1 << SubBucketBits;
+    static const int BucketCount = (40 - SubBucketBits + 1) * SubBuckets; // До ~2^40 мкс
+
+    class Histogram
+    {
+    public:
+        void record(quint64 micros);
+
+    private:
+        Counter buckets[BucketCount];
+        Counter sum;
+        friend class Metrics;
+    };
+
+    struct HistogramSnapshot
+    {
+        quint64 buckets[BucketCount] = {};
+        quint64 count = 0;
+        quint64 sumMicros = 0;
+
+        void add(const Histogram& histogram);
+        // Оставляет только значения, записанные после снимка earlier.
+        void subtract(const HistogramSnapshot& earlier);
+        // Оценка перцентиля (0..1) в микросекундах по середине корзины.
+        double percentile(double quantile) const;
+    };
+
+    struct CommandSnapshot
+    {
+        quint64 count = 0;
+        quint64 errors = 0;
+        quint64 bytesIn = 0;
+        quint64 bytesOut = 0;
+        HistogramSnapshot latency;
+    };
+
+    struct Snapshot
+    {
+        CommandSnapshot commands[int(Protocol::Command::Count)];
+        HistogramSnapshot sql[SqlSiteCount];
+        quint64 unknownCommands = 0;
+        quint64 connectionsAccepted = 0;
+        quint64 bytesOut = 0; // Всего записано в сокеты, включая события
+    };
+
+    static Metrics* getInstance();
+
+    static void recordCommand(Protocol::Command command, quint64 micros, quint64 bytesIn, quint64 bytesOut, bool failed);
+    static void recordUnknownCommand();
+    static void recordSql(SqlSite site, quint64 micros);
+    static void recordConnection();
+    static void recordBytesOut(quint64 bytes);
+    // Монотонное время в микросекундах для замеров.
+    static quint64 nowMicros();
+
+    Snapshot snapshot() const;
+
+    // Замер времени SQL от создания до конца области видимости.
+    class SqlTimer
+    {
+    public:
+        explicit SqlTimer(SqlSite site) : site(site), start(nowMicros()) {}
+        ~SqlTimer() { recordSql(site, nowMicros() - start); }
+
+    private:
+        SqlSite site;
+        quint64 start;
+    };
+
+private:
+    struct CommandStats
+    {
+        Counter count;
+        Counter errors;
+        Counter bytesIn;
+        Counter bytesOut;
+        Histogram latency;
+    };
+
+    struct Shard
+    {
+        CommandStats commands[int(Protocol::Command::Count)];
+        Histogram sql[SqlSiteCount];
+        Counter unknownCommands;
+        Counter connectionsAccepted;
+        Counter bytesOut;
+    };
+
+    Metrics() {}
+    static Shard& local();
+
+    mutable QMutex mutex;   // Только для списка шардов
+    QVector<Shard*> shards;
+};
+
+#endif // METRICS_H
@@ -0,0 +1,66 @@
+#ifndef MODELS_H
+#define MODELS_H
+
+#include <QString>
+#include <QList>
+#include <QVector>
+
+// Простые структуры данных, которыми обмениваются потоки БД и подключения.
+
+struct ChatMessage
+{
+    int messageId = 0;
+    int senderId = 0;
+    qint64 timestamp = 0; // Секунды с начала эпохи (UTC)
+    QString text;
+};
+
+// Какую страницу истории чата вернуть в get_messages.
+struct MessageCursor
+{
+    enum Direction
+    {
+        Latest, // Последние limit сообщений
+        Before, // limit сообщений с message_id < messageId
+        After   // limit сообщений с message_id > messageId (догоняющая синхронизация)
+    };
+
+    int chatId = 0;
+    int limit = 0; // 0 - вся история (старая форма get_messages:<chat_id>)
+    Direction direction = Latest;
+    int messageId = 0;
+};
+
+struct MessagePage
+{
+    QList<ChatMessage> messages; // По возрастанию message_id
+    bool hasMore = false;        // За пределами страницы в том же направлении есть ещё
+};
+
+// Сообщение, принятое к записи (партия MessageWriter).
+struct NewMessage
+{
+    int chatId = 0;
+    int userId = 0;
+    QString text;
+};
+
+// Результат сохранения сообщения: кому из участников чата его разослать.
+struct StoredMessage
+{
+    QString error; // Пустая строка - сообщение сохранено
+    int messageId = -1;
+    QVector<int> participants;
+};
+
+// Строка списка чатов: собирается из сводки чата и отметки о прочтении,
+// без обхода сообщений.
+struct ChatListItem
+{
+    int chatId = 0;
+    QString peerLogin;
+    int unreadCount = 0;
+    ChatMessage lastMessage; // messageId == 0 - в чате ещё нет сообщений
+};
+
+#endif // MODELS_H
@@ -0,0 +1,117 @@
+#ifndef MPSCQUEUE_H
+#define MPSCQUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// Ограниченная lock-free очередь "много писателей - один читатель"
+// (кольцевой буфер с номерами последовательностей в каждой ячейке).
+// tryPush никогда не блокируется: при заполненной очереди он возвращает
+// false, и вызывающий сам решает, что делать с записью.
+template <typename T>
+class MpscQueue
+{
+public:
+    // capacity округляется вверх до степени двойки.
+    explicit MpscQueue(std::size_t capacity)
+    {
+        std::size_t size = 2;
+        while (size < capacity)
+        {
+            size <<= 1;
+        }
+        mask = size - 1;
+        cells = std::vector<Cell>(size);
+        for (std::size_t i = 0; i < size; ++i)
+        {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        enqueuePos.store(0, std::memory_order_relaxed);
+        dequeuePos.store(0, std::memory_order_relaxed);
+    }
+
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    bool tryPush(T value)
+    {
+        Cell* cell;
+        std::size_t pos = enqueuePos.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            cell = &cells[pos & mask];
+            std::size_t seq = cell->sequence.load(std::memory_order_acquire);
+            std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+            if (diff == 0)
+            {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false; // Очередь заполнена
+            }
+            else
+            {
+                pos = enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+        cell->value = std::move(value);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Вызывается только из потока-читателя.
+    bool tryPop(T& out)
+    {
+        std::size_t pos = dequeuePos.load(std::memory_order_relaxed);
+        Cell* cell = &cells[pos & mask];
+        std::size_t seq = cell->sequence.load(std::memory_order_acquire);
+        if (seq != pos + 1)
+        {
+            return false; // Очередь пуста
+        }
+        out = std::move(cell->value);
+        cell->value = T();
+        cell->sequence.store(pos + mask + 1, std::memory_order_release);
+        dequeuePos.store(pos + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // Приблизительный размер: точен только для потока-читателя.
+    std::size_t approximateSize() const
+    {
+        std::size_t head = enqueuePos.load(std::memory_order_relaxed);
+        std::size_t tail = dequeuePos.load(std::memory_order_relaxed);
+        return head >= tail ? head - tail : 0;
+    }
+
+    std::size_t capacity() const { return mask + 1; }
+
+private:
+    struct Cell
+    {
+        std::atomic<std::size_t> sequence;
+        T value;
+
+        Cell() : sequence(0) {}
+        Cell(Cell&& other) : sequence(other.sequence.load(std::memory_order_relaxed)), value(std::move(other.value)) {}
+        Cell& operator=(Cell&& other)
+        {
+            sequence.store(other.sequence.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            value = std::move(other.value);
+            return *this;
+        }
+    };
+
+    std::vector<Cell> cells;
+    std::size_t mask;
+    alignas(64) std::atomic<std::size_t> enqueuePos;
+    alignas(64) std::atomic<std::size_t> dequeuePos;
+};
+
+#endif // MPSCQUEUE_H
@@ -0,0 +1,171 @@
+#include "PasswordHasher.h"
+#include <QMessageAuthenticationCode>
+#include <QRandomGenerator>
+#include <QRunnable>
+#include <QStringList>
+#include <QDebug>
+
+namespace
+{
+
+const char* const Scheme = "pbkdf2_sha256";
+const int SaltSize = 16;
+const int KeySize = 32; // Один блок SHA-256
+
+// Сравнение без раннего выхода: время не зависит от места первого расхождения
+bool equalBytes(const QByteArray& a, const QByteArray& b)
+{
+    if (a.size() != b.size())
+    {
+        return false;
+    }
+    uchar difference = 0;
+    for (int i = 0; i < a.size(); ++i)
+    {
+        difference |= uchar(a[i]) ^ uchar(b[i]);
+    }
+    return difference == 0;
+}
+
+class HashJob : public QRunnable
+{
+public:
+    HashJob(const PasswordHasher::Slot& slot, std::function<void()> job) : slot(slot), job(std::move(job)) {}
+
+    void run() override
+    {
+        job();
+        slot.reset(); // Место освобождается сразу, а не при удалении задачи пулом
+    }
+
+private:
+    PasswordHasher::Slot slot;
+    std::function<void()> job;
+};
+
+} // namespace
+
+PasswordHasher::PasswordHasher(int threadCount, int capacity, int perClientLimit, int iterations)
+    : capacity(qMax(1, capacity)), perClientLimit(qMax(1, perClientLimit)), iterations(qMax(1, iterations)), rejected(0)
+{
+    pool.setMaxThreadCount(qMax(1, threadCount));
+    pool.setExpiryTimeout(-1); // Потоки живут всё время работы сервера
+    dummyHash = hash(QString());
+}
+
+PasswordHasher::~PasswordHasher()
+{
+    pool.waitForDone();
+}
+
+PasswordHasher::Slot PasswordHasher::reserve(const QString& client)
+{
+    {
+        QMutexLocker locker(&mutex);
+        int& used = perClient[client];
+        if (total >= capacity || used >= perClientLimit)
+        {
+            if (used == 0)
+            {
+                perClient.remove(client);
+            }
+            rejected.fetch_add(1, std::memory_order_relaxed);
+            return Slot();
+        }
+        ++used;
+        ++total;
+    }
+    return Slot(this, [this, client](void*) { release(client); });
+}
+
+void PasswordHasher::release(const QString& client)
+{
+    QMutexLocker locker(&mutex);
+    auto it = perClient.find(client);
+    if (it != perClient.end() && --it.value() == 0)
+    {
+        perClient.erase(it);
+    }
+    --total;
+}
+
+void PasswordHasher::run(const Slot& slot, std::function<void()> job)
+{
+    pool.start(new HashJob(slot, std::move(job)));
+}
+
+int PasswordHasher::inFlight() const
+{
+    QMutexLocker locker(&mutex);
+    return total;
+}
+
+QString PasswordHasher::hash(const QString& password) const
+{
+    QByteArray salt(SaltSize, Qt::Uninitialized);
+    QRandomGenerator::system()->fillRange(reinterpret_cast<quint32*>(salt.data()), SaltSize / 4);
+    QByteArray key = pbkdf2(password.toUtf8(), salt, iterations);
+    return QString("%1$%2$%3$%4").arg(QLatin1String(Scheme)).arg(iterations)
+        .arg(QString::fromLatin1(salt.toBase64()), QString::fromLatin1(key.toBase64()));
+}
+
+bool PasswordHasher::verify(const QString& password, const QString& stored, bool* needsRehash) const
+{
+    if (needsRehash)
+    {
+        *needsRehash = false;
+    }
+    if (!stored.startsWith(QString::fromLatin1(Scheme) + QLatin1Char('$')))
+    {
+        // Пароль из прежних версий сервера, хранится как есть
+        bool matches = equalBytes(password.toUtf8(), stored.toUtf8());
+        if (needsRehash)
+        {
+            *needsRehash = matches;
+        }
+        return matches;
+    }
+    QStringList parts = stored.split('$');
+    bool ok = false;
+    const int storedIterations = parts.size() == 4 ? parts[1].toInt(&ok) : 0;
+    if (!ok || storedIterations < 1)
+    {
+        qCritical() << "Malformed password hash in database";
+        return false;
+    }
+    QByteArray salt = QByteArray::fromBase64(parts[2].toLatin1());
+    QByteArray expected = QByteArray::fromBase64(parts[3].toLatin1());
+    bool matches = equalBytes(pbkdf2(password.toUtf8(), salt, storedIterations), expected);
+    if (needsRehash)
+    {
+        *needsRehash = matches && storedIterations < iterations;
+    }
+    return matches;
+}
+
+void PasswordHasher::verifyDummy(const QString& password) const
+{
+    verify(password, dummyHash);
+}
+
+// PBKDF2 (RFC 8018) с HMAC-SHA256; ключ длиной в один выход SHA-256,
+// поэтому считается только первый блок.
+QByteArray PasswordHasher::pbkdf2(const QByteArray& password, const QByteArray& salt, int iterations)
+{
+    QMessageAuthenticationCode mac(QCryptographicHash::Sha256, password);
+    mac.addData(salt);
+    mac.addData("\x00\x00\x00\x01", 4); // Номер блока
+    QByteArray u = mac.result();
+    QByteArray key = u;
+    for (int i = 1; i < iterations; ++i)
+    {
+        mac.reset();
+        mac.addData(u);
+        u = mac.result();
+        for (int j = 0; j < KeySize; ++j)
+        {
+            key[j] = char(key[j] ^ u[j]);
+        }
+    }
+    return key;
+}
@@ -0,0 +1,66 @@
+#ifndef PASSWORDHASHER_H
+#define PASSWORDHASHER_H
+
+#include <QString>
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
+#include <QThreadPool>
+#include <atomic>
+#include <functional>
+#include <memory>
+
+// Хеширование паролей: PBKDF2-HMAC-SHA256 с солью. В базе хранится строка
+//   pbkdf2_sha256$<итераций>$<соль base64>$<хеш base64>
+// Строки без этого префикса - пароли из прежних версий в открытом виде;
+// verify() их тоже принимает и просит перехешировать.
+//
+// Хеш специально медленный (десятки миллисекунд), поэтому считается в
+// отдельном пуле потоков, а не в реакторе или потоке БД. Место в пуле
+// занимается заранее через reserve(): общая очередь ограничена, и с одного
+// адреса одновременно обрабатывается не больше perClientLimit паролей,
+// так что поток входов с одного адреса не отнимает CPU у остальных.
+class PasswordHasher
+{
+public:
+    // Занятое место в пуле; освобождается, когда удалена последняя копия.
+    typedef std::shared_ptr<void> Slot;
+
+    PasswordHasher(int threadCount, int capacity, int perClientLimit, int iterations);
+    ~PasswordHasher();
+
+    // Пустой Slot, если очередь заполнена или адрес исчерпал свой лимит.
+    Slot reserve(const QString& client);
+    // Выполняет job в пуле. slot держится до конца job.
+    void run(const Slot& slot, std::function<void()> job);
+
+    // Сами вычисления; вызываются из потоков пула.
+    QString hash(const QString& password) const;
+    // needsRehash - пароль верный, но хранится в открытом виде или со
+    // старым числом итераций.
+    bool verify(const QString& password, const QString& stored, bool* needsRehash = nullptr) const;
+    // Для несуществующего логина: то же время, что и у настоящей проверки.
+    void verifyDummy(const QString& password) const;
+
+    int inFlight() const;
+    int queueCapacity() const { return capacity; }
+    int threadCount() const { return pool.maxThreadCount(); }
+    quint64 rejectedCount() const { return rejected.load(std::memory_order_relaxed); }
+
+private:
+    void release(const QString& client);
+
+    static QByteArray pbkdf2(const QByteArray& password, const QByteArray& salt, int iterations);
+
+    QThreadPool pool;
+    mutable QMutex mutex;
+    QHash<QString, int> perClient; // Адрес -> занятых мест
+    int total = 0;
+    int capacity;
+    int perClientLimit;
+    int iterations;
+    QString dummyHash;
+    std::atomic<quint64> rejected;
+};
+
+#endif // PASSWORDHASHER_H
@@ -0,0 +1,107 @@
+#include "PostgresStorage.h"
+#include <QDebug>
+
+PostgresStorage::PostgresStorage(const StorageConfig& config)
+    : SqlStorage("QPSQL"), config(config), pool(qMax(1, config.pgPoolSize))
+{
+}
+
+QString PostgresStorage::description() const
+{
+    return QString("PostgreSQL database %1 on %2:%3, pool of %4 connections")
+        .arg(config.pgDatabase, config.pgHost).arg(config.pgPort).arg(qMax(1, config.pgPoolSize));
+}
+
+QString PostgresStorage::sql(Statement statement) const
+{
+    switch (statement)
+    {
+    case AddUser:
+        return "INSERT INTO user_auth (login, password) VALUES (:login, :password) RETURNING user_id";
+    case CreateChat:
+        return "INSERT INTO chats (chat_name, chat_type) VALUES (:chat_name, :chat_type) RETURNING chat_id";
+    case AddReadMarker:
+        return "INSERT INTO chat_read_markers (chat_id, user_id) VALUES (:chat_id, :user_id) "
+               "ON CONFLICT DO NOTHING";
+    case InsertMessage:
+        return "INSERT INTO messages (chat_id, user_id, message_text, timestamp_sent) "
+               "VALUES (:chatId, :userId, :messageText, :timestampSent) RETURNING message_id";
+    case UpdateSummary:
+        return "INSERT INTO chat_summaries "
+               "(chat_id, last_message_id, last_sender_id, last_message_text, last_timestamp) "
+               "VALUES (:chatId, :messageId, :senderId, :messageText, :timestamp) "
+               "ON CONFLICT (chat_id) DO UPDATE SET last_message_id = EXCLUDED.last_message_id, "
+               "last_sender_id = EXCLUDED.last_sender_id, last_message_text = EXCLUDED.last_message_text, "
+               "last_timestamp = EXCLUDED.last_timestamp "
+               "WHERE chat_summaries.last_message_id < EXCLUDED.last_message_id";
+    default:
+        return SqlStorage::sql(statement);
+    }
+}
+
+QString PostgresStorage::epochSeconds(const QString& column) const
+{
+    // timestamp_sent хранится без часового пояса, в UTC
+    return QString("CAST(EXTRACT(EPOCH FROM %1) AS BIGINT)").arg(column);
+}
+
+void PostgresStorage::configure(QSqlDatabase& db) const
+{
+    db.setHostName(config.pgHost);
+    db.setPort(config.pgPort);
+    db.setDatabaseName(config.pgDatabase);
+    db.setUserName(config.pgUser);
+}
+
+bool PostgresStorage::createSchema(QSqlDatabase db)
+{
+    static const char* const statements[] = {
+        "CREATE TABLE IF NOT EXISTS user_auth (user_id SERIAL PRIMARY KEY, "
+        "login TEXT NOT NULL UNIQUE, password TEXT NOT NULL)",
+        "CREATE TABLE IF NOT EXISTS chats (chat_id SERIAL PRIMARY KEY, chat_name TEXT, chat_type TEXT)",
+        "CREATE TABLE IF NOT EXISTS chat_participants (chat_id INTEGER NOT NULL, user_id INTEGER NOT NULL, "
+        "PRIMARY KEY (chat_id, user_id))",
+        "CREATE TABLE IF NOT EXISTS messages (message_id SERIAL PRIMARY KEY, "
+        "chat_id INTEGER NOT NULL, user_id INTEGER NOT NULL, message_text TEXT, "
+        "timestamp_sent TIMESTAMP DEFAULT (now() AT TIME ZONE 'UTC'))",
+        "CREATE TABLE IF NOT EXISTS chat_summaries (chat_id INTEGER PRIMARY KEY, last_message_id INTEGER, "
+        "last_sender_id INTEGER, last_message_text TEXT, last_timestamp BIGINT)",
+        "CREATE TABLE IF NOT EXISTS chat_read_markers (chat_id INTEGER, user_id INTEGER, "
+        "last_read_message_id INTEGER DEFAULT 0, unread_count INTEGER DEFAULT 0, PRIMARY KEY (chat_id, user_id))",
+        // Те же индексы, что и в SQLite
+        "CREATE INDEX IF NOT EXISTS idx_messages_chat_message ON messages (chat_id, message_id)",
+        "CREATE INDEX IF NOT EXISTS idx_messages_chat_time ON messages (chat_id, timestamp_sent)",
+        "CREATE INDEX IF NOT EXISTS idx_chat_participants_user ON chat_participants (user_id, chat_id)",
+    };
+    QSqlQuery query(db);
+    for (const char* statement : statements)
+    {
+        if (!query.exec(statement))
+        {
+            qCritical() << "Failed to create schema:" << query.lastError().text();
+            return false;
+        }
+    }
+    return true;
+}
+
+int PostgresStorage::insertedId(QSqlQuery& query) const
+{
+    // lastInsertId() в QPSQL - это OID строки, поэтому id берём из RETURNING
+    return query.next() ? query.value(0).toInt() : -1;
+}
+
+bool PostgresStorage::acquireConnection()
+{
+    if (!pool.tryAcquire(1, PoolWaitMs))
+    {
+        qCritical() << "No free PostgreSQL connection in the pool after" << PoolWaitMs << "ms";
+        return false;
+    }
+    return true;
+}
+
+void PostgresStorage::releaseConnection()
+{
+    pool.release();
+}
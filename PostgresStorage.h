@@ -0,0 +1,38 @@
+#ifndef POSTGRESSTORAGE_H
+#define POSTGRESSTORAGE_H
+
+#include <QSemaphore>
+#include "SqlStorage.h"
+
+// Хранилище в PostgreSQL (драйвер QPSQL). Соединения образуют
+// фиксированный пул: их число ограничено poolSize, и каждое закреплено за
+// одним потоком БД (потоками DbExecutor и MessageWriter) на всё время его
+// работы - Qt не позволяет передавать QSqlDatabase между потоками. Поток,
+// которому не хватило соединения, ждёт, пока другой поток вернёт своё.
+// Запросы готовятся на сервере (PREPARE) один раз на соединение.
+// В отличие от SQLite, несколько процессов (--reuse-port) пишут в базу
+// параллельно, поэтому сводка чата обновляется только более новым сообщением.
+class PostgresStorage : public SqlStorage
+{
+public:
+    explicit PostgresStorage(const StorageConfig& config);
+
+    QString description() const override;
+
+protected:
+    QString sql(Statement statement) const override;
+    QString epochSeconds(const QString& column) const override;
+    void configure(QSqlDatabase& db) const override;
+    bool createSchema(QSqlDatabase db) override;
+    int insertedId(QSqlQuery& query) const override;
+    bool acquireConnection() override;
+    void releaseConnection() override;
+
+private:
+    StorageConfig config;
+    QSemaphore pool;
+
+    static const int PoolWaitMs = 10000;
+};
+
+#endif // POSTGRESSTORAGE_H
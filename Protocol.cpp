@@ -0,0 +1,497 @@
+#include "Protocol.h"
+#include <cstring>
+
+namespace Protocol
+{
+
+namespace
+{
+
+#define COMMAND(name, command, minFields, maxFields) \
+    { name, int(sizeof(name) - 1), Command::command, minFields, maxFields }
+
+const CommandSpec commandTable[] = {
+    COMMAND("register", Register, 3, 3),
+    COMMAND("login", Login, 3, 3),
+    COMMAND("search", Search, 2, 4),
+    COMMAND("create_chat", CreateChat, 5, 5),
+    COMMAND("get_chats", GetChats, 1, 2),
+    COMMAND("send_message", SendMessage, 4, 4),
+    COMMAND("get_messages", GetMessages, 2, 5),
+    COMMAND("get_user_id", GetUserId, 2, 2),
+    COMMAND("set_protocol", SetProtocol, 2, 2),
+    COMMAND("mark_read", MarkRead, 3, 3),
+    COMMAND("stats", Stats, 1, 1),
+};
+
+const char* const replyNames[int(Reply::Count)] = {
+    "register",
+    "login",
+    "search",
+    "create_chat",
+    "get_chats",
+    "send_message",
+    "get_messages",
+    "get_user_id",
+    "set_protocol",
+    "chat_list_item",
+    "search_result",
+    "search_end",
+    "message_item",
+    "end_of_messages",
+    "user_id",
+    "new_message",
+    "mark_read",
+    "end_of_chats",
+    "stats",
+    "stat_item",
+    "end_of_stats",
+};
+
+// Порядок совпадает с Command
+const Reply commandReplies[int(Command::Count)] = {
+    Reply::Register,
+    Reply::Login,
+    Reply::Search,
+    Reply::CreateChat,
+    Reply::GetChats,
+    Reply::SendMessage,
+    Reply::GetMessages,
+    Reply::GetUserId,
+    Reply::SetProtocol,
+    Reply::MarkRead,
+    Reply::Stats,
+};
+
+void appendUInt32(QByteArray* out, quint32 value)
+{
+    char bytes[4] = { char(value >> 24), char(value >> 16), char(value >> 8), char(value) };
+    out->append(bytes, 4);
+}
+
+quint32 readUInt32(const char* data)
+{
+    const uchar* bytes = reinterpret_cast<const uchar*>(data);
+    return (quint32(bytes[0]) << 24) | (quint32(bytes[1]) << 16) | (quint32(bytes[2]) << 8) | quint32(bytes[3]);
+}
+
+void writeUInt32(char* data, quint32 value)
+{
+    data[0] = char(value >> 24);
+    data[1] = char(value >> 16);
+    data[2] = char(value >> 8);
+    data[3] = char(value);
+}
+
+#undef COMMAND
+
+} // namespace
+
+const CommandSpec* findCommand(const char* name, int size)
+{
+    // Команд немного: сравнение длины отсекает почти все кандидаты без memcmp
+    for (const CommandSpec& spec : commandTable)
+    {
+        if (spec.nameSize == size && std::memcmp(spec.name, name, size) == 0)
+        {
+            return &spec;
+        }
+    }
+    return nullptr;
+}
+
+Reply replyFor(Command command)
+{
+    return commandReplies[int(command)];
+}
+
+const CommandSpec* commandSpec(Command command)
+{
+    // Таблица упорядочена так же, как Command
+    return &commandTable[int(command)];
+}
+
+int splitFields(const char* data, int size, FieldView* fields, int maxFields)
+{
+    if (maxFields <= 0)
+    {
+        return 0;
+    }
+    int count = 0;
+    int start = 0;
+    for (int i = 0; i < size && count < maxFields - 1; ++i)
+    {
+        if (data[i] == '\\')
+        {
+            ++i; // Пропускаем экранированный символ
+        }
+        else if (data[i] == ':')
+        {
+            fields[count].data = data + start;
+            fields[count].size = i - start;
+            ++count;
+            start = i + 1;
+        }
+    }
+    fields[count].data = data + start;
+    fields[count].size = size - start;
+    return count + 1;
+}
+
+int FieldView::toInt(bool* ok) const
+{
+    if (kind == Integer)
+    {
+        bool valid = number >= -0x7fffffffLL - 1 && number <= 0x7fffffffLL;
+        if (ok)
+        {
+            *ok = valid;
+        }
+        return valid ? static_cast<int>(number) : 0;
+    }
+    // Разбор без построения QString
+    bool valid = size > 0;
+    bool negative = false;
+    int i = 0;
+    if (valid && data[0] == '-')
+    {
+        negative = true;
+        i = 1;
+        valid = size > 1;
+    }
+    long long value = 0;
+    for (; valid && i < size; ++i)
+    {
+        if (data[i] < '0' || data[i] > '9' || value > 0x7fffffff)
+        {
+            valid = false;
+            break;
+        }
+        value = value * 10 + (data[i] - '0');
+    }
+    if (valid && value > 0x7fffffffLL + (negative ? 1 : 0))
+    {
+        valid = false;
+    }
+    if (ok)
+    {
+        *ok = valid;
+    }
+    if (!valid)
+    {
+        return 0;
+    }
+    return static_cast<int>(negative ? -value : value);
+}
+
+QString FieldView::toString() const
+{
+    if (kind == Integer)
+    {
+        return QString::number(number);
+    }
+    if (size == 0)
+    {
+        return QString(); // У пустого поля data может быть nullptr
+    }
+    if (kind == Raw || std::memchr(data, '\\', size) == nullptr)
+    {
+        return QString::fromUtf8(data, size);
+    }
+    QByteArray unescaped;
+    unescaped.reserve(size);
+    for (int i = 0; i < size; ++i)
+    {
+        if (data[i] == '\\' && i + 1 < size)
+        {
+            ++i;
+            unescaped += data[i] == 'n' ? '\n' : data[i];
+        }
+        else
+        {
+            unescaped += data[i];
+        }
+    }
+    return QString::fromUtf8(unescaped);
+}
+
+QByteArray escape(const QString& field)
+{
+    QByteArray raw = field.toUtf8();
+    if (raw.indexOf(':') < 0 && raw.indexOf('\\') < 0 && raw.indexOf('\n') < 0)
+    {
+        return raw;
+    }
+    QByteArray escaped;
+    escaped.reserve(raw.size() + 8);
+    for (char c : raw)
+    {
+        switch (c)
+        {
+        case ':': escaped += "\\:"; break;
+        case '\\': escaped += "\\\\"; break;
+        case '\n': escaped += "\\n"; break;
+        default: escaped += c; break;
+        }
+    }
+    return escaped;
+}
+
+int decodeFrame(const char* data, int size, Command* command, quint32* requestId,
+                FieldView* fields, int maxFields)
+{
+    if (size < 5 || maxFields < 1)
+    {
+        return -1;
+    }
+    const int opcode = uchar(data[0]);
+    if (opcode < 1 || opcode > int(Command::Count))
+    {
+        return -1;
+    }
+    *command = static_cast<Command>(opcode - 1);
+    *requestId = readUInt32(data + 1);
+    fields[0] = FieldView();
+
+    int count = 1;
+    int offset = 5;
+    while (offset < size)
+    {
+        if (count == maxFields)
+        {
+            return -1; // Лишние поля
+        }
+        const quint8 type = uchar(data[offset++]);
+        FieldView& field = fields[count++];
+        if (type == IntegerField)
+        {
+            if (size - offset < 8)
+            {
+                return -1;
+            }
+            quint64 value = (quint64(readUInt32(data + offset)) << 32) | readUInt32(data + offset + 4);
+            field.kind = FieldView::Integer;
+            field.number = static_cast<qint64>(value);
+            field.data = data + offset;
+            field.size = 0;
+            offset += 8;
+        }
+        else if (type == BytesField)
+        {
+            if (size - offset < 4)
+            {
+                return -1;
+            }
+            quint32 length = readUInt32(data + offset);
+            offset += 4;
+            if (length > quint32(size - offset))
+            {
+                return -1;
+            }
+            field.kind = FieldView::Raw;
+            field.data = data + offset;
+            field.size = int(length);
+            offset += int(length);
+        }
+        else
+        {
+            return -1;
+        }
+    }
+    return count;
+}
+
+ReplyWriter::ReplyWriter(QByteArray* out, Mode mode, Reply type, quint32 requestId)
+    : out(out), mode(mode), start(out->size())
+{
+    if (mode == Mode::Text)
+    {
+        out->append(replyNames[int(type)]);
+    }
+    else
+    {
+        appendUInt32(out, 0); // Длина проставится в деструкторе
+        out->append(char(ReplyOpcodeBase + quint8(type)));
+        appendUInt32(out, requestId);
+    }
+}
+
+ReplyWriter::ReplyWriter(ReplyWriter&& other) : out(other.out), mode(other.mode), start(other.start)
+{
+    other.out = nullptr;
+}
+
+ReplyWriter::~ReplyWriter()
+{
+    if (out == nullptr)
+    {
+        return;
+    }
+    if (mode == Mode::Text)
+    {
+        out->append('\n');
+    }
+    else
+    {
+        writeUInt32(out->data() + start, quint32(out->size() - start - 4));
+    }
+}
+
+ReplyWriter& ReplyWriter::operator<<(qint64 value)
+{
+    if (mode == Mode::Text)
+    {
+        out->append(':');
+        out->append(QByteArray::number(value));
+    }
+    else
+    {
+        out->append(char(IntegerField));
+        appendUInt32(out, quint32(quint64(value) >> 32));
+        appendUInt32(out, quint32(value));
+    }
+    return *this;
+}
+
+ReplyWriter& ReplyWriter::operator<<(const QString& value)
+{
+    if (mode == Mode::Text)
+    {
+        out->append(':');
+        out->append(escape(value));
+    }
+    else
+    {
+        QByteArray raw = value.toUtf8();
+        writeBytes(raw.constData(), raw.size());
+    }
+    return *this;
+}
+
+ReplyWriter& ReplyWriter::operator<<(const char* value)
+{
+    if (mode == Mode::Text)
+    {
+        out->append(':');
+        out->append(value);
+    }
+    else
+    {
+        writeBytes(value, int(std::strlen(value)));
+    }
+    return *this;
+}
+
+void ReplyWriter::writeBytes(const char* data, int size)
+{
+    out->append(char(BytesField));
+    appendUInt32(out, quint32(size));
+    out->append(data, size);
+}
+
+void LineFramer::append(const QByteArray& data)
+{
+    compact();
+    const int offset = buffer.size();
+    buffer.append(data);
+    for (int i = data.size() - 1; i >= 0; --i)
+    {
+        if (data.at(i) == '\n')
+        {
+            lineStart = offset + i + 1;
+            break;
+        }
+    }
+}
+
+bool LineFramer::nextLine(const char** line, int* size)
+{
+    for (;;)
+    {
+        const char* begin = buffer.constData() + position;
+        const char* end = buffer.constData() + buffer.size();
+        const char* from = buffer.constData() + qMax(position, scanned);
+        const char* newline = static_cast<const char*>(std::memchr(from, '\n', end - from));
+        if (newline == nullptr)
+        {
+            scanned = buffer.size();
+            return false;
+        }
+        int length = int(newline - begin);
+        position += length + 1;
+        scanned = position;
+        if (length > 0 && begin[length - 1] == '\r')
+        {
+            --length;
+        }
+        if (length == 0)
+        {
+            continue; // Пустые строки пропускаем
+        }
+        *line = begin;
+        *size = length;
+        return true;
+    }
+}
+
+QByteArray LineFramer::takeRemaining()
+{
+    QByteArray remaining = buffer.mid(position);
+    buffer.clear();
+    position = 0;
+    scanned = 0;
+    lineStart = 0;
+    return remaining;
+}
+
+bool LineFramer::overflowed() const
+{
+    return buffer.size() - qMax(position, lineStart) > MaxLineSize;
+}
+
+void LineFramer::compact()
+{
+    if (position == 0)
+    {
+        return;
+    }
+    // Сдвигаем только непрочитанный хвост; обычно он пуст или короче строки
+    buffer.remove(0, position);
+    scanned -= position;
+    lineStart = qMax(0, lineStart - position);
+    position = 0;
+}
+
+void FrameReader::append(const QByteArray& data)
+{
+    if (position > 0)
+    {
+        buffer.remove(0, position);
+        position = 0;
+    }
+    buffer.append(data);
+}
+
+bool FrameReader::nextFrame(const char** frame, int* size)
+{
+    if (buffer.size() - position < 4)
+    {
+        return false;
+    }
+    quint32 length = readUInt32(buffer.constData() + position);
+    if (length > quint32(MaxLineSize) || quint32(buffer.size() - position - 4) < length)
+    {
+        return false;
+    }
+    *frame = buffer.constData() + position + 4;
+    *size = int(length);
+    position += 4 + int(length);
+    return true;
+}
+
+bool FrameReader::overflowed() const
+{
+    return buffer.size() - position >= 4 && readUInt32(buffer.constData() + position) > quint32(MaxLineSize);
+}
+
+} // namespace Protocol
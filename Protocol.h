@@ -0,0 +1,196 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <QByteArray>
+#include <QString>
+
+// Текстовый протокол: одна команда на строку, поля разделены ':'.
+// Внутри поля двоеточие, перевод строки и обратная косая черта
+// экранируются как "\:", "\n" и "\\". Последнее поле команды забирает
+// остаток строки целиком, поэтому старые клиенты, не экранирующие ':'
+// в тексте сообщения, тоже работают.
+//
+// После команды "set_protocol:binary" подключение переходит на бинарные
+// кадры (все числа - big-endian):
+//   uint32 длина остатка кадра | uint8 код операции | uint32 id запроса | поля
+// Поле: uint8 тип (1 - int64, 2 - байты) и int64 либо uint32 длина + байты.
+// Код операции запроса - Command + 1, ответа - ReplyOpcodeBase + Reply.
+// Ответ несёт id запроса, на который отвечает; у событий сервера id = 0.
+namespace Protocol
+{
+
+enum class Mode
+{
+    Text,
+    Binary
+};
+
+// Поле команды - участок исходного буфера без копирования.
+struct FieldView
+{
+    enum Kind
+    {
+        Escaped, // Текстовый протокол: может содержать "\:" и т.п.
+        Raw,     // Бинарный протокол: байты как есть
+        Integer  // Бинарный протокол: число в number
+    };
+
+    const char* data = nullptr;
+    int size = 0;
+    Kind kind = Escaped;
+    qint64 number = 0;
+
+    bool isEmpty() const { return size == 0 && kind != Integer; }
+    int toInt(bool* ok = nullptr) const;
+    // Снимает экранирование; копирование происходит только здесь.
+    QString toString() const;
+};
+
+enum class Command
+{
+    Register,
+    Login,
+    Search,
+    CreateChat,
+    GetChats,
+    SendMessage,
+    GetMessages,
+    GetUserId,
+    SetProtocol,
+    MarkRead,
+    Stats,
+    Count
+};
+
+// Типы ответов. Первые совпадают с Command: ими отвечают на саму команду.
+// Ответы на команды, добавленные позже, идут в конце, чтобы не сдвигать
+// коды операций бинарного протокола (см. replyFor).
+enum class Reply
+{
+    Register,
+    Login,
+    Search,
+    CreateChat,
+    GetChats,
+    SendMessage,
+    GetMessages,
+    GetUserId,
+    SetProtocol,
+    ChatListItem,
+    SearchResult,
+    SearchEnd,
+    MessageItem,
+    EndOfMessages,
+    UserId,
+    NewMessage, // Событие: new_message:chat_id:sender_id:message_id:text
+    MarkRead,
+    EndOfChats, // Конец списка chat_list_item в ответе на get_chats
+    Stats,
+    StatItem,   // stat_item:<метрика{метки}>:<значение>
+    EndOfStats,
+    Count
+};
+
+const quint8 ReplyOpcodeBase = 0x80;
+const quint8 IntegerField = 1;
+const quint8 BytesField = 2;
+
+// Тип ответа на саму команду.
+Reply replyFor(Command command);
+
+struct CommandSpec
+{
+    const char* name;
+    int nameSize;
+    Command command;
+    int minFields; // Вместе с именем команды
+    int maxFields; // Последнее поле забирает остаток строки
+};
+
+const int MaxFields = 8;
+const int MaxLineSize = 64 * 1024;
+
+// Ищет команду по имени в таблице команд; nullptr, если команда неизвестна.
+const CommandSpec* findCommand(const char* name, int size);
+const CommandSpec* commandSpec(Command command);
+
+// Делит строку на поля по неэкранированным ':'. Возвращает число полей.
+int splitFields(const char* data, int size, FieldView* fields, int maxFields);
+
+// Экранирует поле для ответа клиенту.
+QByteArray escape(const QString& field);
+
+// Разбирает бинарный кадр (без поля длины). fields[0] соответствует имени
+// команды и остаётся пустым, чтобы обработчики не зависели от протокола.
+// Возвращает число полей вместе с fields[0] или -1 для битого кадра.
+int decodeFrame(const char* data, int size, Command* command, quint32* requestId,
+                FieldView* fields, int maxFields);
+
+// Дописывает один ответ в буфер out в нужном протоколе. Текстовый ответ
+// завершается '\n', у бинарного длина проставляется в деструкторе.
+class ReplyWriter
+{
+public:
+    ReplyWriter(QByteArray* out, Mode mode, Reply type, quint32 requestId);
+    ReplyWriter(ReplyWriter&& other);
+    ReplyWriter(const ReplyWriter&) = delete;
+    ReplyWriter& operator=(const ReplyWriter&) = delete;
+    ~ReplyWriter();
+
+    ReplyWriter& operator<<(int value) { return *this << qint64(value); }
+    ReplyWriter& operator<<(qint64 value);
+    ReplyWriter& operator<<(const QString& value);
+    ReplyWriter& operator<<(const char* value); // Служебные слова: "success", "fail"
+
+private:
+    void writeBytes(const char* data, int size);
+
+    QByteArray* out;
+    Mode mode;
+    int start;
+};
+
+// Буфер приёма одного подключения с построчной нарезкой. Команда,
+// пришедшая несколькими TCP-сегментами, собирается здесь целиком.
+class LineFramer
+{
+public:
+    void append(const QByteArray& data);
+    // Выдаёт следующую полную строку (без '\n' и '\r') как view на буфер.
+    // View действителен до следующего вызова append().
+    bool nextLine(const char** line, int* size);
+    // true, если недописанная строка в конце буфера длиннее MaxLineSize.
+    // Полные строки, которые ждут своей очереди, не считаются.
+    bool overflowed() const;
+    int bufferedBytes() const { return buffer.size() - position; }
+    // Забирает ещё не разобранные байты (при смене протокола).
+    QByteArray takeRemaining();
+
+private:
+    void compact();
+
+    QByteArray buffer;
+    int position = 0;   // Начало ещё не выданных данных
+    int scanned = 0;    // До этого места '\n' уже искали
+    int lineStart = 0;  // Начало недописанной строки: байт после последнего '\n'
+};
+
+// Буфер приёма для бинарных кадров с префиксом длины.
+class FrameReader
+{
+public:
+    void append(const QByteArray& data);
+    // Выдаёт тело следующего полного кадра (после поля длины).
+    bool nextFrame(const char** frame, int* size);
+    // true, если заявлена длина кадра больше MaxLineSize.
+    bool overflowed() const;
+    int bufferedBytes() const { return buffer.size() - position; }
+
+private:
+    QByteArray buffer;
+    int position = 0;
+};
+
+} // namespace Protocol
+
+#endif // PROTOCOL_H
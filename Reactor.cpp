@@ -0,0 +1,122 @@
+#include "Reactor.h"
+#include "ClientConnection.h"
+#include "Server.h"
+#include "Metrics.h"
+#include <QTcpSocket>
+
+Reactor::Reactor(Server* server, int idleTimeoutMs, QObject *parent)
+    : QObject(parent), server(server), idleTimeoutMs(idleTimeoutMs), idleTimer(new QTimer(this)),
+      connections(0), idleClosed(0) {
+    connect(idleTimer, &QTimer::timeout, this, &Reactor::closeIdle);
+}
+
+void Reactor::start() {
+    if (idleTimeoutMs > 0) {
+        // Подключение закрывается не позже чем через 1.25 таймаута простоя
+        idleTimer->start(qMax(1000, idleTimeoutMs / 4));
+    }
+}
+
+void Reactor::addConnection(qintptr socketDescriptor) {
+    QTcpSocket* socket = new QTcpSocket();
+    if (!socket->setSocketDescriptor(socketDescriptor)) {
+        qCritical() << "Failed to accept connection:" << socket->errorString();
+        delete socket;
+        connections.fetch_sub(1, std::memory_order_relaxed);
+        return;
+    }
+    ClientConnection* connection = new ClientConnection(server, server->dbExecutor(), socket, this);
+    clients.insert(connection);
+    Metrics::recordConnection();
+    // Подключение удаляет себя после разрыва (deleteLater), здесь освобождаем его место
+    connect(connection, &QObject::destroyed, this, [this, connection]() {
+        clients.remove(connection);
+        connections.fetch_sub(1, std::memory_order_relaxed);
+    });
+}
+
+void Reactor::closeIdle() {
+    const QSet<ClientConnection*> current = clients;
+    for (ClientConnection* connection : current) {
+        if (connection->idleMs() >= idleTimeoutMs) {
+            idleClosed.fetch_add(1, std::memory_order_relaxed);
+            connection->socket()->abort(); // disconnected -> deleteLater
+        }
+    }
+}
+
+void Reactor::shutdown() {
+    idleTimer->stop();
+    qDeleteAll(findChildren<ClientConnection*>(QString(), Qt::FindDirectChildrenOnly));
+}
+
+ReactorPool::ReactorPool(Server* server, int threadCount, int maxConnections, int idleTimeoutMs, QObject *parent)
+    : QObject(parent), maxConnections(maxConnections), rejected(0) {
+    if (threadCount < 1) {
+        threadCount = 1;
+    }
+    for (int i = 0; i < threadCount; ++i) {
+        QThread* thread = new QThread();
+        thread->setObjectName(QString("reactor-%1").arg(i));
+        Reactor* reactor = new Reactor(server, idleTimeoutMs);
+        reactor->moveToThread(thread);
+        thread->start();
+        QMetaObject::invokeMethod(reactor, [reactor]() { reactor->start(); }, Qt::QueuedConnection);
+        threads.append(thread);
+        reactors.append(reactor);
+    }
+}
+
+ReactorPool::~ReactorPool() {
+    for (int i = 0; i < reactors.size(); ++i) {
+        Reactor* reactor = reactors.at(i);
+        QMetaObject::invokeMethod(reactor, [reactor]() { reactor->shutdown(); }, Qt::BlockingQueuedConnection);
+        threads.at(i)->quit();
+        threads.at(i)->wait();
+        delete reactor;
+        delete threads.at(i);
+    }
+}
+
+void ReactorPool::dispatch(qintptr socketDescriptor) {
+    // Счётчики растут только здесь, в потоке Server, поэтому лимит не превышается
+    if (maxConnections > 0 && connectionCount() >= maxConnections) {
+        rejected.fetch_add(1, std::memory_order_relaxed);
+        QTcpSocket socket;
+        if (socket.setSocketDescriptor(socketDescriptor)) {
+            socket.abort();
+        }
+        return;
+    }
+    // Наименее загруженный реактор; обход начинаем со следующего по кругу
+    int best = next;
+    for (int i = 1; i < reactors.size(); ++i) {
+        int candidate = (next + i) % reactors.size();
+        if (reactors.at(candidate)->connectionCount() < reactors.at(best)->connectionCount()) {
+            best = candidate;
+        }
+    }
+    next = (next + 1) % reactors.size();
+
+    Reactor* reactor = reactors.at(best);
+    reactor->reserveConnection();
+    QMetaObject::invokeMethod(reactor, [reactor, socketDescriptor]() {
+        reactor->addConnection(socketDescriptor);
+    }, Qt::QueuedConnection);
+}
+
+int ReactorPool::connectionCount() const {
+    int total = 0;
+    for (const Reactor* reactor : reactors) {
+        total += reactor->connectionCount();
+    }
+    return total;
+}
+
+quint64 ReactorPool::idleClosedCount() const {
+    quint64 total = 0;
+    for (const Reactor* reactor : reactors) {
+        total += reactor->idleClosedCount();
+    }
+    return total;
+}
@@ -0,0 +1,69 @@
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include <QObject>
+#include <QThread>
+#include <QVector>
+#include <QSet>
+#include <QTimer>
+#include <atomic>
+
+class Server;
+class ClientConnection;
+
+// Цикл событий одного рабочего потока. Принимает дескрипторы сокетов от
+// Server и обслуживает созданные на них подключения в своём потоке.
+// Реактор владеет подключениями: удаляет их при разрыве и закрывает те,
+// от которых idleTimeoutMs ничего не приходило и которым ничего не ушло.
+class Reactor : public QObject {
+    Q_OBJECT
+
+public:
+    Reactor(Server* server, int idleTimeoutMs, QObject *parent = nullptr);
+    // Вместе с дескрипторами, которые уже переданы реактору, но ещё не приняты
+    int connectionCount() const { return connections.load(std::memory_order_relaxed); }
+    quint64 idleClosedCount() const { return idleClosed.load(std::memory_order_relaxed); }
+    // Вызывается из потока Server перед передачей дескриптора.
+    void reserveConnection() { connections.fetch_add(1, std::memory_order_relaxed); }
+    void addConnection(qintptr socketDescriptor);
+    void start();
+    // Закрывает все подключения и останавливает таймер простоя; выполняется
+    // в потоке реактора. Своего соединения с БД у реактора нет - запросы
+    // идут через DbExecutor.
+    void shutdown();
+
+private:
+    void closeIdle();
+
+    Server* server;
+    int idleTimeoutMs;
+    QTimer* idleTimer;
+    QSet<ClientConnection*> clients;
+    std::atomic<int> connections;
+    std::atomic<quint64> idleClosed;
+};
+
+// Пул из N реакторов, каждый в своём потоке. Новое подключение получает
+// наименее загруженный реактор (при равенстве - по кругу). Сверх
+// maxConnections подключения сразу закрываются.
+class ReactorPool : public QObject {
+    Q_OBJECT
+
+public:
+    ReactorPool(Server* server, int threadCount, int maxConnections, int idleTimeoutMs, QObject *parent = nullptr);
+    ~ReactorPool();
+    void dispatch(qintptr socketDescriptor);
+    int threadCount() const { return reactors.size(); }
+    int connectionCount() const;
+    quint64 rejectedCount() const { return rejected.load(std::memory_order_relaxed); }
+    quint64 idleClosedCount() const;
+
+private:
+    QVector<QThread*> threads;
+    QVector<Reactor*> reactors;
+    int next = 0;
+    int maxConnections;
+    std::atomic<quint64> rejected;
+};
+
+#endif // REACTOR_H
@@ -0,0 +1,209 @@
+#include "RecentMessageCache.h"
+
+RecentMessageCache::RecentMessageCache(int messagesPerChat, qint64 budgetBytes)
+    : capacity(qMax(1, messagesPerChat)), budget(qBound<qint64>(1, budgetBytes, 0x7fffffff)),
+      chats(int(budget)), hitCount(0), missCount(0)
+{
+}
+
+int RecentMessageCache::Ring::lowerBound(int messageId) const
+{
+    int low = 0;
+    int high = size();
+    while (low < high)
+    {
+        int middle = (low + high) / 2;
+        if (at(middle).messageId < messageId)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+bool RecentMessageCache::Ring::push(const ChatMessage& message, int capacity)
+{
+    // MessageWriter вызывает append уже после COMMIT, поэтому загрузка чата,
+    // прошедшая между ними, успевает прочитать это сообщение из базы
+    if (!slots.isEmpty() && message.messageId <= at(size() - 1).messageId)
+    {
+        return false;
+    }
+    textBytes += message.text.size() * qint64(sizeof(QChar));
+    if (slots.size() < capacity)
+    {
+        slots.append(message);
+        return true;
+    }
+    // Буфер полон: самое старое сообщение уходит, история больше не полная
+    textBytes -= slots.at(head).text.size() * qint64(sizeof(QChar));
+    slots[head] = message;
+    head = (head + 1) % slots.size();
+    complete = false;
+    return true;
+}
+
+int RecentMessageCache::cost(const Ring& ring) const
+{
+    return int(sizeof(Ring) + ring.slots.capacity() * qint64(sizeof(ChatMessage)) + ring.textBytes);
+}
+
+void RecentMessageCache::reinsert(int chatId, Ring* ring)
+{
+    // QCache не умеет менять стоимость записи: вынимаем и кладём заново.
+    // Слишком большой для бюджета чат QCache сразу удаляет
+    chats.take(chatId);
+    chats.insert(chatId, ring, cost(*ring));
+}
+
+bool RecentMessageCache::lookup(const MessageCursor& cursor, MessagePage* page)
+{
+    QMutexLocker locker(&mutex);
+    if (readLocked(cursor, page))
+    {
+        hitCount.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+    missCount.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+bool RecentMessageCache::read(const MessageCursor& cursor, MessagePage* page)
+{
+    QMutexLocker locker(&mutex);
+    return readLocked(cursor, page);
+}
+
+bool RecentMessageCache::readLocked(const MessageCursor& cursor, MessagePage* page)
+{
+    const Ring* ring = chats.object(cursor.chatId);
+    if (ring == nullptr)
+    {
+        return false;
+    }
+    const int size = ring->size();
+    int from = 0;
+    int to = 0;
+    bool hasMore = false;
+    if (cursor.limit == 0)
+    {
+        // Старая форма get_messages: только если в буфере вся история
+        if (!ring->complete)
+        {
+            return false;
+        }
+        to = size;
+    }
+    else if (cursor.direction == MessageCursor::After)
+    {
+        // Все сообщения новее курсора в буфере, если курсор не старше его начала
+        if (!ring->complete && (size == 0 || ring->at(0).messageId > cursor.messageId))
+        {
+            return false;
+        }
+        from = ring->lowerBound(cursor.messageId + 1);
+        to = qMin(size, from + cursor.limit);
+        hasMore = to < size;
+    }
+    else
+    {
+        to = cursor.direction == MessageCursor::Latest ? size : ring->lowerBound(cursor.messageId);
+        from = qMax(0, to - cursor.limit);
+        // Страница упёрлась в начало буфера: без полной истории неизвестно,
+        // есть ли сообщения раньше, и не добрать недостающие
+        if (from == 0 && !ring->complete)
+        {
+            return false;
+        }
+        hasMore = from > 0;
+    }
+    page->messages.clear();
+    page->messages.reserve(to - from);
+    for (int i = from; i < to; ++i)
+    {
+        page->messages.append(ring->at(i));
+    }
+    page->hasMore = hasMore;
+    return true;
+}
+
+bool RecentMessageCache::contains(int chatId)
+{
+    QMutexLocker locker(&mutex);
+    return chats.contains(chatId);
+}
+
+bool RecentMessageCache::beginLoad(int chatId)
+{
+    QMutexLocker locker(&mutex);
+    if (chats.contains(chatId) || loading.contains(chatId))
+    {
+        return false;
+    }
+    loading.insert(chatId, false);
+    return true;
+}
+
+void RecentMessageCache::finishLoad(int chatId, const QList<ChatMessage>& latest, bool complete)
+{
+    QMutexLocker locker(&mutex);
+    // Если во время загрузки в чат записали, выборка могла это сообщение
+    // не увидеть: такой буфер не кладём, следующий промах загрузит заново
+    const bool written = loading.take(chatId);
+    if (written)
+    {
+        return;
+    }
+    Ring* ring = new Ring();
+    ring->slots.reserve(qMin(capacity, qMax(latest.size(), 16)));
+    ring->complete = complete && latest.size() <= capacity;
+    const int skip = qMax(0, latest.size() - capacity);
+    for (int i = skip; i < latest.size(); ++i)
+    {
+        ring->push(latest.at(i), capacity);
+    }
+    chats.insert(chatId, ring, cost(*ring));
+}
+
+void RecentMessageCache::cancelLoad(int chatId)
+{
+    QMutexLocker locker(&mutex);
+    loading.remove(chatId);
+}
+
+void RecentMessageCache::append(int chatId, const ChatMessage& message)
+{
+    QMutexLocker locker(&mutex);
+    QHash<int, bool>::iterator pending = loading.find(chatId);
+    if (pending != loading.end())
+    {
+        pending.value() = true;
+        return;
+    }
+    // object() заодно поднимает чат в начало LRU
+    Ring* ring = chats.object(chatId);
+    if (ring == nullptr)
+    {
+        return;
+    }
+    if (ring->push(message, capacity))
+    {
+        reinsert(chatId, ring);
+    }
+}
+
+qint64 RecentMessageCache::memoryUsed() const
+{
+    QMutexLocker locker(&mutex);
+    return chats.totalCost();
+}
+
+int RecentMessageCache::chatCount() const
+{
+    QMutexLocker locker(&mutex);
+    return chats.size();
+}
@@ -0,0 +1,77 @@
+#ifndef RECENTMESSAGECACHE_H
+#define RECENTMESSAGECACHE_H
+
+#include <QCache>
+#include <QHash>
+#include <QMutex>
+#include <QVector>
+#include <atomic>
+#include "Models.h"
+
+// Последние сообщения активных чатов в памяти процесса. На чат - кольцевой
+// буфер из не более чем messagesPerChat сообщений в одном непрерывном
+// массиве. Чаты вытесняются по LRU (QCache) так, чтобы их суммарный
+// примерный объём не превышал бюджет.
+//
+// Буфер чата всегда хранит непрерывный хвост его истории: загружается
+// лениво последними сообщениями из базы, а send_message дописывает в него
+// каждое сообщение после COMMIT.
+class RecentMessageCache
+{
+public:
+    RecentMessageCache(int messagesPerChat, qint64 budgetBytes);
+
+    // Отвечает на get_messages из памяти, если страница целиком в буфере.
+    // lookup считает попадания и промахи, read - нет.
+    bool lookup(const MessageCursor& cursor, MessagePage* page);
+    bool read(const MessageCursor& cursor, MessagePage* page);
+
+    bool contains(int chatId);
+    // Загрузка чата из базы: beginLoad возвращает false, если чат уже
+    // в кэше или его загружает другой поток. latest - последние сообщения
+    // по возрастанию message_id, complete - других сообщений в чате нет.
+    bool beginLoad(int chatId);
+    void finishLoad(int chatId, const QList<ChatMessage>& latest, bool complete);
+    void cancelLoad(int chatId);
+
+    // Новое сохранённое сообщение; чаты вне кэша пропускаются.
+    void append(int chatId, const ChatMessage& message);
+
+    int messagesPerChat() const { return capacity; }
+    quint64 hits() const { return hitCount.load(std::memory_order_relaxed); }
+    quint64 misses() const { return missCount.load(std::memory_order_relaxed); }
+    qint64 memoryUsed() const;
+    qint64 memoryBudget() const { return budget; }
+    int chatCount() const;
+
+private:
+    struct Ring
+    {
+        QVector<ChatMessage> slots; // Растёт до capacity, затем перезаписывается по кругу
+        int head = 0;               // Индекс самого старого сообщения
+        bool complete = false;      // В буфере вся история чата
+        qint64 textBytes = 0;
+
+        int size() const { return slots.size(); }
+        const ChatMessage& at(int i) const { return slots.at((head + i) % slots.size()); }
+        // Позиция первого сообщения с message_id >= messageId.
+        int lowerBound(int messageId) const;
+        // Дописывает сообщение новее последнего в буфере; false - оно уже
+        // есть (или старше) и пропущено.
+        bool push(const ChatMessage& message, int capacity);
+    };
+
+    bool readLocked(const MessageCursor& cursor, MessagePage* page);
+    int cost(const Ring& ring) const;
+    void reinsert(int chatId, Ring* ring);
+
+    const int capacity;
+    const qint64 budget;
+    mutable QMutex mutex;
+    QCache<int, Ring> chats;   // Стоимость записи - примерный объём в байтах
+    QHash<int, bool> loading;  // chat_id -> пока грузился, в чат писали
+    std::atomic<quint64> hitCount;
+    std::atomic<quint64> missCount;
+};
+
+#endif // RECENTMESSAGECACHE_H
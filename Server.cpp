@@ -1,277 +1,509 @@
 #include "Server.h"
 #include "Logger.h"
+#include "Reactor.h"
+#include "ClientConnection.h"
+#include "Protocol.h"
+#include "Metrics.h"
+#include "StatsEndpoint.h"
+#include "EventBus.h"
+#ifdef Q_OS_LINUX
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#endif
 
-Server::Server(QObject *parent) : QTcpServer(parent) {
-    window = new QWidget();
-    window->resize(window_width, window_height);
-
-    logFileNameLabel = new QLabel(tr("Файл логов: %1").arg(QFileInfo(currentLogFilePath).fileName()));
-    logFileNameLabel->setAlignment(Qt::AlignRight);
-    statusLabel = new QLabel("Сервер работает.");
-    statusLabel->setAlignment(Qt::AlignLeft);  // Выравнивание текста по центру
-    statusLabel->setStyleSheet("QLabel { color : green; }");
-    logViewer = new QPlainTextEdit();
-    logViewer->setReadOnly(true);
-    logFileButton = new QPushButton("Выбрать файл для логгирования");
-    layout = new QVBoxLayout(window);
-
-    QHBoxLayout *headerLayout = new QHBoxLayout();
-    headerLayout->addWidget(logFileNameLabel);
-    headerLayout->addStretch();  // Добавление растяжения для разделения меток
-    headerLayout->addWidget(statusLabel);
-
-    layout->addLayout(headerLayout);
-    layout->addWidget(logViewer);
-    layout->addWidget(logFileButton);
-
-    window->setLayout(layout);
-    window->setWindowTitle("Сервер");
-    window->show();
-
-    connect(logFileButton, &QPushButton::clicked, this, &Server::selectLogFile);
-
-    QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE");
-    db.setDatabaseName(QDir::homePath() + "/messenger.db");
-
-    if (!db.open())
+Server::Server(const ServerConfig& config, QObject *parent) : QTcpServer(parent) {
+    metricsPort = config.metricsPort;
+    reusePort = config.reusePort;
+    StorageConfig storageConfig = config.storage;
+    if (storageConfig.pgPoolSize <= 0) {
+        // По соединению на поток БД и поток записи сообщений
+        storageConfig.pgPoolSize = qMax(1, config.dbThreads) + 1;
+    }
+    storage = Storage::create(storageConfig);
+    if (!storage->open())
     {
-        qCritical() << "Could not connect to database:" << db.lastError().text();
+        qCritical() << "Could not open storage:" << storage->description();
         exit(1);
     }
 
-    connect(this, &Server::newConnection, this, &Server::onNewConnection);
-    Logger::getInstance()->logToFile("Server is running");
+    executor = new DbExecutor(storage, config.dbThreads, config.dbQueueCapacity);
+    hasher = new PasswordHasher(config.hashThreads, config.hashQueueCapacity, config.hashPerClient,
+                                config.hashIterations);
+    // Кэш последних сообщений не видит записей других процессов, поэтому при
+    // --reuse-port (и при нулевом бюджете) его нет вовсе: recentMessages
+    // остаётся nullptr, и страницы читаются прямо из базы
+    MessageWriter::CommittedHandler committed;
+    if (!config.reusePort && config.recentMessagesBudget > 0) {
+        recentMessages = new RecentMessageCache(config.recentMessagesPerChat, config.recentMessagesBudget);
+        RecentMessageCache* recent = recentMessages;
+        committed = [recent](int chatId, const ChatMessage& message) { recent->append(chatId, message); };
+    }
+    writer = new MessageWriter(storage, config.messageBatchSize, config.messageBatchDelayMs, config.dbQueueCapacity,
+                               [this](int chatId) { return getChatParticipants(chatId); }, committed);
+    identities = new IdentityCache(config.identityCacheSize);
+    int warmed = identities->warmUp(storage);
+    searchIndex = new UserSearchIndex();
+    searchIndex->load(storage);
+    // Дальше хранилищем пользуются только потоки БД; соединение этого потока
+    // возвращается в пул
+    storage->releaseThread();
 
-    logUpdateTimer = new QTimer(this);
-    connect(logUpdateTimer, &QTimer::timeout, this, &Server::updateLogViewer);
-    logUpdateTimer->start(1000);
+    reactors = new ReactorPool(this, config.reactorThreads, config.maxConnections, config.idleTimeoutSec * 1000, this);
+    Logger::getInstance()->logToFile(QString("Server is running with %1 reactor threads and %2 database threads "
+                                             "on %3, %4 identities cached")
+                                     .arg(reactors->threadCount())
+                                     .arg(executor->threadCount())
+                                     .arg(storage->description())
+                                     .arg(warmed));
 }
 
 Server::~Server() {
+    close();
+    delete statsEndpoint;
+    statsEndpoint = nullptr;
+    // Подключения обращаются к Server, поэтому реакторы гасим до разрушения его полей
+    delete reactors;
+    reactors = nullptr;
+    userSockets.setPresenceHandler(nullptr);
+    delete bus;
+    bus = nullptr;
+    // Принятые сообщения дописываются в базу до выхода
+    delete writer;
+    writer = nullptr;
+    // Уже принятые запросы дорабатывают, но ответы никому не отправляются.
+    // Потоки БД запускают задачи PasswordHasher, а те ставят запросы в
+    // executor, поэтому сначала закрываем очередь БД и дожидаемся её потоков,
+    // затем пула хешей (их запросы в закрытую очередь отклоняются), и только
+    // после этого удаляем executor
+    executor->shutdown();
+    delete hasher;
+    hasher = nullptr;
+    delete executor;
+    executor = nullptr;
+    delete storage;
+    storage = nullptr;
+    delete recentMessages;
+    recentMessages = nullptr;
+    delete identities;
+    identities = nullptr;
+    delete searchIndex;
+    searchIndex = nullptr;
     Logger::getInstance()->logToFile("Server is turned off");
-    if (window) {
-        delete window;
-    }
+}
+
+void Server::incomingConnection(qintptr socketDescriptor) {
+    reactors->dispatch(socketDescriptor);
+}
+
+int Server::connectionCount() const {
+    return reactors ? reactors->connectionCount() : 0;
+}
+
+quint64 Server::rejectedConnections() const {
+    return reactors ? reactors->rejectedCount() : 0;
+}
+
+quint64 Server::idleDisconnects() const {
+    return reactors ? reactors->idleClosedCount() : 0;
 }
 
 bool Server::isLoginFree(const QString& username) {
-    QSqlQuery query;
-    query.prepare("SELECT COUNT(*) FROM user_auth WHERE login = :login");
-    query.bindValue(":login", username);
-    if (!query.exec())
-    {
-        qCritical() << "Failed to check if login is free:" << query.lastError().text();
+    int cachedId;
+    switch (identities->lookup(username, &cachedId)) {
+    case IdentityCache::Found:
         return false;
+    case IdentityCache::Missing:
+        return true;
+    case IdentityCache::Unknown:
+        break;
     }
-    if (query.next())
-    {
-        return query.value(0).toInt() == 0;
-    }
-    return false;
+    Metrics::SqlTimer sqlTimer(Metrics::SqlIsLoginFree);
+    bool ok = false;
+    const int userId = storage->findUser(username, &ok);
+    return ok && userId == -1;
 }
 
-void Server::addUserToDatabase(const QString& username, const QString& password) {
-    QSqlQuery query;
-    query.prepare("INSERT INTO user_auth (login, password) VALUES (:login, :password)");
-    query.bindValue(":login", username);
-    query.bindValue(":password", password);
-    if (!query.exec()) {
-        qCritical() << "Failed to add user to database:" << query.lastError().text();
-    } else {
-        qDebug() << "User" << username << "successfully added.";
+bool Server::addUserToDatabase(const QString& username, const QString& passwordHash) {
+    Metrics::SqlTimer sqlTimer(Metrics::SqlAddUser);
+    const int userId = storage->addUser(username, passwordHash);
+    if (userId == -1) {
+        return false;
     }
+    identities->insert(username, userId);
+    searchIndex->add(username);
+    if (bus) {
+        bus->publishUser(username, userId);
+    }
+    qDebug() << "User" << username << "successfully added.";
+    return true;
 }
 
-void Server::startServer(int port) {
-    if (!this->listen(QHostAddress::Any, port)) {
+bool Server::startServer(int port) {
+    if (reusePort) {
+        // Шина нужна до приёма подключений: через неё расходится присутствие
+        bus = new EventBus(QString("messenger-%1").arg(port),
+            [this](const QVector<int>& userIds, const QByteArray& textEvent, const QByteArray& binaryEvent) {
+                userSockets.post(userIds, textEvent, binaryEvent);
+            },
+            [this](const QString& login, int userId) {
+                identities->insert(login, userId);
+                searchIndex->add(login);
+            }, this);
+        EventBus* events = bus;
+        userSockets.setPresenceHandler([events](int userId, bool online) { events->setPresence(userId, online); });
+        bus->start();
+    }
+    if (!(reusePort ? listenReusePort(port) : this->listen(QHostAddress::Any, port))) {
         qCritical() << "Could not start server";
-    } else {
-        qDebug() << "Server started on port" << port;
+        return false;
     }
+    qDebug() << "Server started on port" << port;
+    if (metricsPort > 0) {
+        // Без метрик сервер работает, поэтому ошибка здесь не фатальна
+        statsEndpoint = new StatsEndpoint(this, this);
+        statsEndpoint->start(quint16(metricsPort));
+    }
+    return true;
 }
 
-bool Server::validateUser(const QString& username, const QString& password) {
-    QSqlQuery query;
-    query.prepare("SELECT password FROM user_auth WHERE login = :login");
-    query.bindValue(":login", username);
-    if (!query.exec()) {
-        qCritical() << "Failed to check user credentials:" << query.lastError().text();
+// Слушающий сокет создаётся вручную: QTcpServer не выставляет SO_REUSEPORT.
+// Ядро распределяет входящие подключения между всеми процессами на порту.
+bool Server::listenReusePort(int port) {
+#ifdef Q_OS_LINUX
+    // Как QHostAddress::Any: IPv6 с приёмом IPv4, а без IPv6 - только IPv4
+    int family = AF_INET6;
+    int fd = ::socket(AF_INET6, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (fd < 0) {
+        family = AF_INET;
+        fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    }
+    if (fd < 0) {
+        qCritical() << "Could not create listening socket:" << strerror(errno);
         return false;
     }
-    if (query.next()) {
-        QString storedPassword = query.value(0).toString();
-        return password == storedPassword;
+    int on = 1;
+    int off = 0;
+    ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if (::setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) != 0) {
+        qCritical() << "SO_REUSEPORT is not supported:" << strerror(errno);
+        ::close(fd);
+        return false;
+    }
+    int bound;
+    if (family == AF_INET6) {
+        ::setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));
+        sockaddr_in6 address = {};
+        address.sin6_family = AF_INET6;
+        address.sin6_addr = in6addr_any;
+        address.sin6_port = htons(quint16(port));
+        bound = ::bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+    } else {
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_ANY);
+        address.sin_port = htons(quint16(port));
+        bound = ::bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address));
     }
+    if (bound != 0 || ::listen(fd, SOMAXCONN) != 0) {
+        qCritical() << "Could not listen on port" << port << ":" << strerror(errno);
+        ::close(fd);
+        return false;
+    }
+    if (!setSocketDescriptor(fd)) {
+        qCritical() << "Could not use listening socket:" << errorString();
+        ::close(fd);
+        return false;
+    }
+    return true;
+#else
+    Q_UNUSED(port);
+    qCritical() << "--reuse-port is only supported on Linux";
     return false;
+#endif
 }
 
-void Server::processRegistration(QTcpSocket* clientSocket, const QString& username, const QString& password) {
-    if(isLoginFree(username)) {
-        addUserToDatabase(username, password); // Добавляем пользователя в базу
-        QTextStream stream(clientSocket);
-        stream << "register:success\n";
-        stream.flush(); // Гарантируем отправку сообщения
-        Logger::getInstance()->logToFile("Registered user " + username);
-    } else {
-        QTextStream stream(clientSocket);
-        stream << "register:fail:username taken\n";
-        stream.flush(); // Гарантируем отправку сообщения
-        qDebug("register:fail:username taken\n");
+int Server::findCredentials(const QString& username, QString* storedPassword) {
+    Metrics::SqlTimer sqlTimer(Metrics::SqlAuthenticate);
+    const int userId = storage->findCredentials(username, storedPassword);
+    if (userId != -1) {
+        identities->insert(username, userId);
     }
+    return userId;
 }
 
-void Server::processLogin(QTcpSocket* clientSocket, const QString& username, const QString& password) {
-    if(validateUser(username, password)) {
-        QTextStream stream(clientSocket);
-        stream << "login:success\n";
-        stream.flush(); // Гарантируем отправку сообщения
-        Logger::getInstance()->logToFile("User " + username + " is logged in");
-    } else {
-        QTextStream stream(clientSocket);
-        stream << "login:fail\n";
-        stream.flush(); // Гарантируем отправку сообщения
-    }
+bool Server::updatePasswordHash(int userId, const QString& passwordHash) {
+    Metrics::SqlTimer sqlTimer(Metrics::SqlUpdatePassword);
+    return storage->updatePasswordHash(userId, passwordHash);
 }
 
-void Server::onNewConnection() {
-    QTcpSocket *clientSocket = this->nextPendingConnection();
-    connect(clientSocket, &QTcpSocket::readyRead, this, [this, clientSocket]() {
+namespace {
 
-        QTextStream stream(clientSocket);
-        QString message = stream.readAll().trimmed();
-        qDebug() << "New message received:" << message;
-        QStringList smallMessage = message.trimmed().split("\n", QString::SkipEmptyParts);
-        for(const QString &line : smallMessage)
-        {
-            qDebug() << "New message received:" << line;
-        QStringList parts = line.split(":");
-        if(parts.isEmpty()) return; // Если сообщение пустое, то ничего не делаем
-        QString command = parts.first();
-            if(command == "register" || command == "login") {
-                if(parts.count() < 3) return; // Для регистрации и входа нужно минимум 3 части
-                QString username = parts.at(1);
-                QString password = parts.at(2);
-                if(command == "register")
-                {
-                    processRegistration(clientSocket, username, password);
-                }
-                else
-                { // Здесь else, так как команда может быть только "login"
-                    processLogin(clientSocket, username, password);
+enum RegistrationResult { Registered, LoginTaken, RegistrationFailed, RegistrationBusy };
+
+struct LoginCheck {
+    int userId = -1;
+    QString rehashed; // Новый хеш, если пароль хранился в открытом виде или со старыми параметрами
+};
+
+}
+
+// Хеш считается в пуле PasswordHasher, затем пользователь записывается
+// в потоке БД. Место в пуле занимается сразу в потоке реактора: если
+// адрес клиента исчерпал лимит, он получает "register:fail:server busy".
+void Server::processRegistration(ClientConnection* client, const QString& username, const QString& password) {
+    int cachedId;
+    if (identities->lookup(username, &cachedId) == IdentityCache::Found) {
+        // Занятый логин отклоняем, не тратя время на хеш
+        client->fail(Protocol::Reply::Register) << "username taken";
+        return;
+    }
+    PasswordHasher* hasher = this->hasher;
+    DbExecutor* executor = this->executor;
+    const QString address = client->socket()->peerAddress().toString();
+    client->await<RegistrationResult>(Protocol::Reply::Register,
+        [this, hasher, executor, address, username, password](const std::shared_ptr<ResultGuard>& guard,
+                                                             const std::function<void(const RegistrationResult&)>& resume) {
+        PasswordHasher::Slot slot = hasher->reserve(address);
+        if (!slot) {
+            return false;
+        }
+        hasher->run(slot, [this, hasher, executor, guard, resume, username, password]() {
+            const QString passwordHash = hasher->hash(password);
+            bool queued = executor->submit(guard, [this, username, passwordHash]() {
+                if (!isLoginFree(username)) {
+                    return LoginTaken;
                 }
+                return addUserToDatabase(username, passwordHash) ? Registered : RegistrationFailed;
+            }, resume);
+            if (!queued) {
+                guard->post([resume]() { resume(RegistrationBusy); });
             }
-            else if (command == "search")
-            {
-                if(parts.count() < 2) return; // Для поиска нужно минимум 2 части
-                QString searchText = parts.at(1);
-                processSearchRequest(clientSocket, searchText);
-            }
-            else if (command == "create_chat") {
-                QString chatName = parts.at(1);
-                QString chatType = parts.at(2);
-                QString userName1 = parts.at(3);
-                QString userName2 = parts.at(4);
-                int chatId = createChat(chatName, chatType, userName1, userName2);
-                if (chatId != -1)
-                {
-                    stream << "create_chat:success:" << chatId << '\n';
-                    addUserToChat(chatId, findUserID(userName1));
-                    addUserToChat(chatId, findUserID(userName2));
-                }
-                else
-                {
-                    stream << "create_chat:fail\n";
-                }
-                stream.flush();
-            } else if (command == "get_chats")
-            {
-                if(parts.count() < 2) return;
-                QString username = parts.at(1);
-                int userId = findUserID(username);
-                if (userId != -1)
-                {
-                    getChatsForUser(clientSocket, userId);
-                }
-            } else if (command == "send_message")
-            {
-                if(parts.count() < 4) return; // Нужно минимум 4 части для отправки сообщения
-                int chatId = parts.at(1).toInt();
-                int userId = parts.at(2).toInt();
-                QString messageText = parts.at(3);
-                QSqlQuery query;
-                query.prepare("INSERT INTO messages (chat_id, user_id, message_text) VALUES (:chatId, :userId, :messageText)");
-                query.bindValue(":chatId", chatId);
-                query.bindValue(":userId", userId);
-                query.bindValue(":messageText", messageText);
-                if (query.exec())
-                {
-                    stream << "send_message:success\n";
-                    QString logMessage = QString("User with ID %1 sent a message to chat with ID %2.\nMessage: %3")
-                        .arg(QString::number(userId))
-                        .arg(QString::number(chatId))
-                        .arg(messageText);
-                    Logger::getInstance()->logToFile(logMessage);
-                }
-                else
-                {
-                    stream << "send_message:fail:" << query.lastError().text() << "\n";
+        });
+        return true;
+    }, [client, username](RegistrationResult result) {
+        switch (result) {
+        case Registered:
+            client->reply(Protocol::Reply::Register) << "success";
+            Logger::getInstance()->logToFile("Registered user " + username);
+            break;
+        case LoginTaken:
+            client->fail(Protocol::Reply::Register) << "username taken";
+            qDebug("register:fail:username taken\n");
+            break;
+        case RegistrationFailed:
+            client->fail(Protocol::Reply::Register);
+            break;
+        case RegistrationBusy:
+            client->fail(Protocol::Reply::Register) << "server busy";
+            break;
+        }
+    });
+}
+
+// Сохранённый пароль читается в потоке БД и проверяется в пуле
+// PasswordHasher. Для несуществующего логина тоже считается хеш, чтобы по
+// времени ответа нельзя было узнать, есть ли такой пользователь. Пароли
+// старых записей при первом успешном входе перезаписываются хешем.
+void Server::processLogin(ClientConnection* client, const QString& username, const QString& password) {
+    PasswordHasher* hasher = this->hasher;
+    DbExecutor* executor = this->executor;
+    const QString address = client->socket()->peerAddress().toString();
+    client->await<LoginCheck>(Protocol::Reply::Login,
+        [this, hasher, executor, address, username, password](const std::shared_ptr<ResultGuard>& guard,
+                                                             const std::function<void(const LoginCheck&)>& resume) {
+        PasswordHasher::Slot slot = hasher->reserve(address);
+        if (!slot) {
+            return false;
+        }
+        // Если очередь БД заполнена, лямбда удаляется и место в пуле освобождается
+        return executor->submit(std::function<void()>([this, hasher, slot, guard, resume, username, password]() {
+            QString storedPassword;
+            const int userId = findCredentials(username, &storedPassword);
+            hasher->run(slot, [hasher, guard, resume, userId, storedPassword, password]() {
+                LoginCheck check;
+                bool needsRehash = false;
+                if (userId == -1) {
+                    hasher->verifyDummy(password);
+                } else if (hasher->verify(password, storedPassword, &needsRehash)) {
+                    check.userId = userId;
+                    if (needsRehash) {
+                        check.rehashed = hasher->hash(password);
+                    }
                 }
-                stream.flush();
-            }
-            else if (command == "get_messages")
-            {
-                if(parts.count() < 2) return;
-                int chatId = parts.at(1).toInt();
-                getMessagesForChat(clientSocket, chatId);
-            }
-            else if (command == "get_user_id")
-            {
-                if(parts.count() < 2) return;
-                QString login = parts.at(1);
-                getUserId(clientSocket, login);
+                guard->post([resume, check]() { resume(check); });
+            });
+        }));
+    }, [this, client, username](const LoginCheck& check) {
+        if (check.userId != -1) {
+            if (!check.rehashed.isEmpty()) {
+                // Ответ не ждёт записи; если очередь БД полна, перехешируем при следующем входе
+                const int userId = check.userId;
+                const QString passwordHash = check.rehashed;
+                this->executor->submit(std::function<void()>([this, userId, passwordHash]() {
+                    updatePasswordHash(userId, passwordHash);
+                }));
             }
+            // Теперь подключение получает события new_message этого пользователя
+            client->setAuthenticatedUser(check.userId);
+            client->reply(Protocol::Reply::Login) << "success";
+            Logger::getInstance()->logToFile("User " + username + " is logged in");
+        } else {
+            client->fail(Protocol::Reply::Login);
         }
     });
 }
 
-void Server::getChatsForUser(QTcpSocket* clientSocket, int userId) {
-    QSqlQuery query;
-    query.prepare("SELECT ua.login, c.chat_id FROM user_auth ua "
-                  "JOIN chat_participants cp ON cp.user_id = ua.user_id "
-                  "JOIN chats c ON c.chat_id = cp.chat_id "
-                  "WHERE c.chat_id IN (SELECT chat_id FROM chat_participants WHERE user_id = :user_id) "
-                  "AND ua.user_id != :user_id");
-    query.bindValue(":user_id", userId);
-    if (query.exec()) {
-        QTextStream stream(clientSocket);
-        while (query.next()) {
-            QString username = query.value(0).toString();
-            QString chatId = query.value(1).toString();
-            stream << "chat_list_item:" << chatId << ":" << username << '\n'; // Отправляем каждый результат клиенту
+void Server::processCreateChat(ClientConnection* client, const QString& chatName, const QString& chatType, const QString& userName1, const QString& userName2) {
+    client->query(Protocol::Reply::CreateChat, [this, chatName, chatType, userName1, userName2]() {
+        int chatId = createChat(chatName, chatType, userName1, userName2);
+        if (chatId != -1)
+        {
+            addUserToChat(chatId, findUserID(userName1));
+            addUserToChat(chatId, findUserID(userName2));
         }
-        stream.flush();
-    } else {
-        qCritical() << "Failed to get chats for user:" << query.lastError().text();
+        return chatId;
+    }, [client](int chatId) {
+        if (chatId != -1)
+        {
+            client->reply(Protocol::Reply::CreateChat) << "success" << chatId;
+        }
+        else
+        {
+            client->fail(Protocol::Reply::CreateChat);
+        }
+    });
+}
+
+void Server::processSendMessage(ClientConnection* client, int chatId, int userId, const QString& messageText) {
+    // Подтверждение уходит после COMMIT партии, в которую попало сообщение
+    MessageWriter* writer = this->writer;
+    client->await<StoredMessage>(Protocol::Reply::SendMessage,
+        [writer, chatId, userId, messageText](const std::shared_ptr<ResultGuard>& guard,
+                                              const MessageWriter::Done& resume) {
+        return writer->submit(guard, chatId, userId, messageText, resume);
+    }, [this, client, chatId, userId, messageText](const StoredMessage& stored) {
+        if (stored.error.isEmpty())
+        {
+            client->reply(Protocol::Reply::SendMessage) << "success";
+            broadcastNewMessage(client, chatId, userId, stored, messageText);
+            // Текст сообщения в лог не пишем: только идентификаторы и длину
+            QString logMessage = QString("User with ID %1 sent a message to chat with ID %2 (%3 chars).")
+                .arg(userId)
+                .arg(chatId)
+                .arg(messageText.size());
+            Logger::getInstance()->logToFile(logMessage);
+        }
+        else
+        {
+            client->fail(Protocol::Reply::SendMessage) << stored.error;
+        }
+    });
+}
+
+QVector<int> Server::getChatParticipants(int chatId) {
+    Metrics::SqlTimer sqlTimer(Metrics::SqlChatParticipants);
+    return storage->chatParticipants(chatId);
+}
+
+void Server::broadcastNewMessage(const ClientConnection* sender, int chatId, int userId, const StoredMessage& message, const QString& messageText) {
+    // Событие сериализуется один раз на протокол, дальше все подключения
+    // получают общий буфер. Участники не в сети увидят сообщение через
+    // get_messages при следующем подключении.
+    QByteArray textEvent;
+    QByteArray binaryEvent;
+    {
+        Protocol::ReplyWriter text(&textEvent, Protocol::Mode::Text, Protocol::Reply::NewMessage, 0);
+        text << chatId << userId << message.messageId << messageText;
+        Protocol::ReplyWriter binary(&binaryEvent, Protocol::Mode::Binary, Protocol::Reply::NewMessage, 0);
+        binary << chatId << userId << message.messageId << messageText;
+    }
+    userSockets.post(message.participants, textEvent, binaryEvent, sender);
+    // Другим процессам - только если там есть кто-то из участников, включая
+    // другие подключения отправителя
+    if (bus && bus->anyOnlineElsewhere(message.participants)) {
+        bus->publishMessage(message.participants, textEvent, binaryEvent);
     }
 }
 
-void Server::getUserId(QTcpSocket* clientSocket, const QString& login) {
-    QSqlQuery query;
-    query.prepare("SELECT user_id FROM user_auth WHERE login = :login");
-    query.bindValue(":login", login);
-    if (query.exec() && query.next()) {
-        int userId = query.value(0).toInt();
-        QTextStream stream(clientSocket);
-        stream << "user_id:" << userId << "\n";
-        stream.flush();
-        qDebug() << "UserID = " << userId << "\n";
-    } else {
-        qCritical() << "Failed to get user ID for login:" << query.lastError().text();
+void Server::processGetChats(ClientConnection* client, int userId) {
+    client->query(Protocol::Reply::GetChats, [this, userId]() {
+        return getChatsForUser(userId);
+    }, [client](const QList<ChatListItem>& chats) {
+        client->streamReplies(chats.size(), [client, chats](int i) {
+            const ChatListItem& chat = chats[i];
+            // Новые поля дописаны после прежних chat_id и логина; текст последнего
+            // сообщения - в конце, так как может содержать что угодно
+            client->reply(Protocol::Reply::ChatListItem) << chat.chatId << chat.peerLogin << chat.unreadCount
+                                                         << chat.lastMessage.messageId << chat.lastMessage.senderId
+                                                         << chat.lastMessage.timestamp << chat.lastMessage.text;
+        }, [client]() {
+            // Как end_of_messages и search_end: клиент видит, что список закончился,
+            // даже если чатов нет
+            client->reply(Protocol::Reply::EndOfChats);
+        });
+    });
+}
+
+QList<ChatListItem> Server::getChatsForUser(int userId) {
+    Metrics::SqlTimer sqlTimer(Metrics::SqlGetChats);
+    return storage->chatsForUser(userId);
+}
+
+enum MarkReadResult { Marked, NotParticipant, MarkReadFailed };
+
+void Server::processMarkRead(ClientConnection* client, int chatId, int userId, int messageId) {
+    client->query(Protocol::Reply::MarkRead, [this, chatId, userId, messageId]() {
+        // Отметку ставит только участник чата
+        if (!getChatParticipants(chatId).contains(userId)) {
+            return NotParticipant;
+        }
+        return markRead(chatId, userId, messageId) ? Marked : MarkReadFailed;
+    }, [client](MarkReadResult result) {
+        switch (result) {
+        case Marked:
+            client->reply(Protocol::Reply::MarkRead) << "success";
+            break;
+        case NotParticipant:
+            client->fail(Protocol::Reply::MarkRead) << "not a participant";
+            break;
+        case MarkReadFailed:
+            client->fail(Protocol::Reply::MarkRead);
+            break;
+        }
+    });
+}
+
+bool Server::markRead(int chatId, int userId, int messageId) {
+    Metrics::SqlTimer sqlTimer(Metrics::SqlMarkRead);
+    return storage->markRead(chatId, userId, messageId);
+}
+
+void Server::getUserId(ClientConnection* client, const QString& login) {
+    // Попадание в кэш отвечаем сразу из потока подключения, без очереди БД
+    int cachedId;
+    switch (identities->lookup(login, &cachedId)) {
+    case IdentityCache::Found:
+        client->reply(Protocol::Reply::UserId) << cachedId;
+        return;
+    case IdentityCache::Missing:
+        return;
+    case IdentityCache::Unknown:
+        break;
     }
+    client->query(Protocol::Reply::GetUserId, [this, login]() {
+        return findUserID(login);
+    }, [client](int userId) {
+        if (userId != -1) {
+            client->reply(Protocol::Reply::UserId) << userId;
+            qDebug() << "UserID = " << userId << "\n";
+        }
+    });
 }
 
 int Server::createChat(const QString& chatName, const QString& chatType, const QString& userName1, const QString& userName2) {
-    QSqlQuery query;
     int userId1 = findUserID(userName1);
     int userId2 = findUserID(userName2);
 
@@ -284,123 +516,168 @@ int Server::createChat(const QString& chatName, const QString& chatType, const Q
         qCritical() << "Chat between these users already exists";
         return -1;
     }
+    Metrics::SqlTimer sqlTimer(Metrics::SqlCreateChat);
     qDebug() << "chatName: " << chatName << " chatType: " << chatType << "\n";
-    query.prepare("INSERT INTO chats (chat_name, chat_type) VALUES (:chat_name, :chat_type)");
-    query.bindValue(":chat_name", chatName);
-    query.bindValue(":chat_type", chatType);
-    if (!query.exec()) {
-        qCritical() << "Failed to create chat:" << query.lastError().text();
-        return -1;
-    }
-    return query.lastInsertId().toInt();
+    return storage->createChat(chatName, chatType);
 }
 
 void Server::addUserToChat(const int chatId, const int userId) {
-    QSqlQuery query;
-    query.prepare("INSERT INTO chat_participants (chat_id, user_id) VALUES (:chat_id, :user_id)");
-    query.bindValue(":chat_id", chatId);
-    query.bindValue(":user_id", userId);
-    if (!query.exec()) {
-        qCritical() << "Failed to add user to chat:" << query.lastError().text();
-    }
+    Metrics::SqlTimer sqlTimer(Metrics::SqlAddUserToChat);
+    storage->addParticipant(chatId, userId);
 }
 
 int Server::findUserID(const QString& userName)
 {
-    QSqlQuery query;
-    query.prepare("SELECT user_id FROM user_auth WHERE login = :userName");
-    query.bindValue(":userName", userName);
-    if (!query.exec())
+    int cachedId;
+    switch (identities->lookup(userName, &cachedId))
     {
-        qCritical() << "Failed to find user_id:" << query.lastError().text();
+    case IdentityCache::Found:
+        return cachedId;
+    case IdentityCache::Missing:
         return -1;
+    case IdentityCache::Unknown:
+        break;
     }
-    else
+    Metrics::SqlTimer sqlTimer(Metrics::SqlFindUserId);
+    bool ok = false;
+    const int userId = storage->findUser(userName, &ok);
+    if (!ok)
     {
-        if (query.next()) // Перемещаем курсор на следующую запись в результатах запроса.
-        {
-            return query.value(0).toInt(); // Теперь мы можем безопасно получить значение.
-        }
-        else
-        {
-            qCritical() << "User not found";
-            return -1;
-        }
+        return -1;
+    }
+    if (userId == -1)
+    {
+        identities->insertMissing(userName);
+        qCritical() << "User not found";
+        return -1;
     }
+    identities->insert(userName, userId);
+    return userId;
 }
 
 bool Server::chatExistsBetweenUsers(const int userId1, const int userId2) {
-    QSqlQuery query;
-    query.prepare("SELECT chat_id FROM chat_participants WHERE user_id = :userId1 "
-                  "INTERSECT "
-                  "SELECT chat_id FROM chat_participants WHERE user_id = :userId2");
-    query.bindValue(":userId1", userId1);
-    query.bindValue(":userId2", userId2);
-    if (!query.exec() || !query.next()) {
-        return false; // Чата нет, можно создать новый
-    } else {
-        return true; // Чат между пользователями уже существует
+    Metrics::SqlTimer sqlTimer(Metrics::SqlChatExists);
+    return storage->chatExistsBetween(userId1, userId2);
+}
+
+void Server::processSearchRequest(ClientConnection* client, const QString& searchText, int offset, int limit) {
+    // Поиск идёт по индексу в памяти, поэтому отвечаем сразу из потока
+    // подключения; строки пишутся по мере того, как клиент их забирает
+    const QStringList logins = searchUsers(searchText, offset, limit);
+    client->streamReplies(logins.size(), [client, logins](int i) {
+        client->reply(Protocol::Reply::SearchResult) << logins[i];
+    }, [client]() {
+        client->reply(Protocol::Reply::SearchEnd); // Signal the end of search results
+    });
+}
+
+QStringList Server::searchUsers(const QString& searchText, int offset, int limit) {
+    return searchIndex->search(searchText, qMax(0, offset), qBound(1, limit, MaxSearchResults));
+}
+
+void Server::getMessagesForChat(ClientConnection* client, const MessageCursor& cursor) {
+    // Страницы горячих чатов отдаём из памяти прямо в потоке подключения
+    MessagePage cached;
+    if (recentMessages && recentMessages->lookup(cursor, &cached)) {
+        sendMessagePage(client, cursor, cached);
+        return;
     }
+    if (cursor.limit == 0) {
+        streamMessageHistory(client, cursor.chatId, 0);
+        return;
+    }
+    client->query(Protocol::Reply::GetMessages, [this, cursor]() {
+        MessagePage page;
+        if (loadRecentMessages(cursor.chatId) && recentMessages->read(cursor, &page)) {
+            return page;
+        }
+        return loadMessagePage(cursor);
+    }, [client, cursor](const MessagePage& page) {
+        sendMessagePage(client, cursor, page);
+    });
 }
 
-void Server::processSearchRequest(QTcpSocket* clientSocket, const QString& searchText) {
-    QSqlQuery query;
-    query.prepare("SELECT login FROM user_auth WHERE login LIKE :searchText");
-    query.bindValue(":searchText", "%" + searchText + "%");
-    if (query.exec()) {
-        QTextStream stream(clientSocket);
-        qDebug() << "Search query successful. Results for:" << searchText;
-        while (query.next()) {
-            QString username = query.value(0).toString();
-            stream << "search_result:" << username << '\n'; // Send each result to the client
-            stream.flush();
-            qDebug() << "Found user:" << username; // Logging each found username
+// Вся история чата (старая форма get_messages:<chat_id>): читается из базы
+// частями по HistoryChunkSize сообщений по индексу (chat_id, message_id),
+// и следующая часть запрашивается, только когда предыдущая ушла клиенту.
+// Так длинная история не собирается целиком ни в памяти, ни в сокете.
+void Server::streamMessageHistory(ClientConnection* client, int chatId, int afterMessageId) {
+    MessageCursor chunk;
+    chunk.chatId = chatId;
+    chunk.limit = HistoryChunkSize;
+    chunk.direction = MessageCursor::After;
+    chunk.messageId = afterMessageId;
+    client->query(Protocol::Reply::GetMessages, [this, chunk]() {
+        MessagePage page;
+        MessageCursor whole = chunk;
+        whole.limit = 0;
+        if (chunk.messageId == 0 && loadRecentMessages(chunk.chatId) && recentMessages->read(whole, &page)) {
+            return page; // Короткая история целиком в кэше
         }
-        stream << "search_end\n"; // Signal the end of search results
-        stream.flush();
-    } else {
-        qCritical() << "Search query failed:" << query.lastError().text();
-    }
+        return loadMessagePage(chunk);
+    }, [this, client, chunk](const MessagePage& page) {
+        client->streamReplies(page.messages.size(), [client, page](int i) {
+            writeMessageItem(client, page.messages[i]);
+        }, [this, client, chunk, page]() {
+            if (page.hasMore && !page.messages.isEmpty()) {
+                streamMessageHistory(client, chunk.chatId, page.messages.last().messageId);
+            } else {
+                client->reply(Protocol::Reply::EndOfMessages);
+            }
+        });
+    });
+}
+
+void Server::writeMessageItem(ClientConnection* client, const ChatMessage& message) {
+    // user_id, как и раньше, сразу после текста; id и время - в конце
+    client->reply(Protocol::Reply::MessageItem) << message.text << message.senderId
+                                                << message.messageId << message.timestamp;
 }
 
-void Server::getMessagesForChat(QTcpSocket* clientSocket, int chatId) {
-    QSqlQuery query;
-    // Добавляем выборку user_id сообщения в запрос
-    query.prepare("SELECT user_id, message_text FROM messages WHERE chat_id = :chatId ORDER BY timestamp_sent ASC");
-    query.bindValue(":chatId", chatId);
-    if (query.exec()) {
-        QTextStream stream(clientSocket);
-        while (query.next()) {
-            int senderId = query.value(0).toInt(); // ID пользователя отправившего сообщение
-            QString message = query.value(1).toString();
-            // Добавляем user_id в конец каждого сообщения
-            stream << "message_item:" << message << ":" << senderId << '\n'; // 'user_id' в конце
+void Server::sendMessagePage(ClientConnection* client, const MessageCursor& cursor, const MessagePage& page) {
+    client->streamReplies(page.messages.size(), [client, page](int i) {
+        writeMessageItem(client, page.messages[i]);
+    }, [client, cursor, page]() {
+        // Отправляем сигнал конца передачи сообщений; постраничный ответ
+        // дополнительно сообщает, есть ли ещё сообщения за страницей
+        if (cursor.limit == 0) {
+            client->reply(Protocol::Reply::EndOfMessages);
+        } else {
+            client->reply(Protocol::Reply::EndOfMessages) << (page.hasMore ? 1 : 0);
         }
-        stream << "end_of_messages\n"; // Отправляем сигнал конца передачи сообщений
-        stream.flush();
-    } else {
-        qCritical() << "Failed to get messages for chat:" << query.lastError().text();
-    }
+    });
 }
 
-void Server::updateLogViewer() {
-    QFile logFile(currentLogFilePath);
-    if (logFile.open(QIODevice::ReadOnly)) {
-        QTextStream stream(&logFile);
-        logViewer->setPlainText(stream.readAll());
-        logFile.close();
-        QScrollBar *scrollBar = logViewer->verticalScrollBar();
-        scrollBar->setValue(scrollBar->maximum());
+// Загружает в кэш последние сообщения чата, если его там ещё нет.
+// Вызывается из потока БД. true - чат в кэше и страницу можно читать из
+// него; false - кэш выключен, чат сейчас грузит другой поток, загрузка не
+// удалась или чат не поместился в бюджет.
+bool Server::loadRecentMessages(int chatId) {
+    if (recentMessages == nullptr) {
+        return false;
+    }
+    if (!recentMessages->beginLoad(chatId)) {
+        return recentMessages->contains(chatId);
+    }
+    MessageCursor latest;
+    latest.chatId = chatId;
+    latest.limit = recentMessages->messagesPerChat();
+    bool ok = false;
+    MessagePage page = loadMessagePage(latest, &ok);
+    if (!ok) {
+        recentMessages->cancelLoad(chatId);
+        return false;
     }
+    recentMessages->finishLoad(chatId, page.messages, !page.hasMore);
+    return recentMessages->contains(chatId);
 }
 
-void Server::selectLogFile() {
-    QString filename = QFileDialog::getOpenFileName(window, tr("Открыть файл"), QDir::homePath(), tr("Log Files (*.txt)"));
-    if(!filename.isEmpty()) {
-        Logger::getInstance()->setLogFile(filename);
-        currentLogFilePath = filename;
-        updateLogViewer();  // Сразу обновляем содержимое лога в интерфейсе
-        // Здесь же обновляем надпись с именем файла логов
-        logFileNameLabel->setText(tr("Файл логов: %1").arg(QFileInfo(filename).fileName()));
+MessagePage Server::loadMessagePage(const MessageCursor& cursor, bool* ok) {
+    Metrics::SqlTimer sqlTimer(Metrics::SqlLoadMessagePage);
+    bool loaded = false;
+    MessagePage page = storage->loadMessagePage(cursor, &loaded);
+    if (ok) {
+        *ok = loaded;
     }
+    return page;
 }
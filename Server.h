@@ -1,61 +1,128 @@
 #ifndef SERVER_H
 #define SERVER_H
 
-#include <QWidget>
-#include <QLabel>
-#include <QPushButton>
-#include <QVBoxLayout>
-#include <QFileDialog>
 #include <QTcpServer>
 #include <QTcpSocket>
 #include <QCoreApplication>
 #include <QTextStream>
-#include <QSqlDatabase>
-#include <QSqlQuery>
-#include <QSqlError>
+#include <QDebug>
 #include <QDir>
-#include <QPlainTextEdit>
-#include <QFormLayout>
-#include <QTimer>
-#include <QScrollBar>
+#include "UserRegistry.h"
+#include "DbExecutor.h"
+#include "Models.h"
+#include "IdentityCache.h"
+#include "UserSearchIndex.h"
+#include "MessageWriter.h"
+#include "RecentMessageCache.h"
+#include "PasswordHasher.h"
+#include "Storage.h"
 
+class ReactorPool;
+class EventBus;
+class StatsEndpoint;
+class ClientConnection;
+
+// Параметры запуска ядра сервера (см. опции командной строки в main.cpp).
+struct ServerConfig
+{
+    StorageConfig storage;
+    int reactorThreads = 1;
+    int maxConnections = 20000;  // 0 - без ограничения
+    int idleTimeoutSec = 600;    // Закрывать молчащие подключения; 0 - никогда
+    int dbThreads = 4;
+    int dbQueueCapacity = 1024;
+    int identityCacheSize = 100000;
+    int messageBatchSize = 256;
+    int messageBatchDelayMs = 2;
+    int recentMessagesPerChat = 200;
+    qint64 recentMessagesBudget = 64 * 1024 * 1024; // Байт на весь кэш последних сообщений
+    int metricsPort = 9464; // HTTP /metrics на localhost; 0 - не запускать
+    // Несколько процессов на одном порту (SO_REUSEPORT) с общей базой и шиной событий
+    bool reusePort = false;
+    int hashThreads = 2;
+    int hashQueueCapacity = 256;
+    int hashPerClient = 4;     // Одновременных register/login с одного адреса
+    int hashIterations = 50000;
+};
+
+// Сетевое и database-ядро сервера. Не зависит от Qt Widgets, поэтому
+// может работать как в headless-режиме (QCoreApplication), так и под
+// управлением графического окна ServerWindow.
+// Сам Server только принимает подключения: сокеты обслуживаются пулом
+// реакторов, и обработчики process* вызываются из их потоков. Обращения к
+// хранилищу (isLoginFree, createChat, loadMessagePage и т.д.) выполняются
+// только в потоках DbExecutor; send_message пишется партиями в потоке MessageWriter,
+// пароли хешируются и проверяются в пуле PasswordHasher.
 class Server : public QTcpServer {
     Q_OBJECT
 
 public:
-    Server(QObject *parent = nullptr);
+    explicit Server(const ServerConfig& config, QObject *parent = nullptr);
     ~Server();
     bool isLoginFree(const QString& username);
-    void addUserToDatabase(const QString& username, const QString& password);
-    void startServer(int port);
-    bool validateUser(const QString& username, const QString& password);
-    void processRegistration(QTcpSocket* clientSocket, const QString& username, const QString& password);
-    void processLogin(QTcpSocket* clientSocket, const QString& username, const QString& password);
+    bool addUserToDatabase(const QString& username, const QString& passwordHash);
+    bool startServer(int port);
+    // user_id и сохранённый пароль (хеш или открытый текст старых записей); -1, если логина нет.
+    int findCredentials(const QString& username, QString* storedPassword);
+    bool updatePasswordHash(int userId, const QString& passwordHash);
+    QVector<int> getChatParticipants(int chatId);
+    void processRegistration(ClientConnection* client, const QString& username, const QString& password);
+    void processLogin(ClientConnection* client, const QString& username, const QString& password);
     int createChat(const QString& chatName, const QString& chatType, const QString& userName1, const QString& userName2);
     int findUserID(const QString& userName);
     bool chatExistsBetweenUsers(const int userId1, const int userId2);
-    void getChatsForUser(QTcpSocket* clientSocket, int userId);
-    void getMessagesForChat(QTcpSocket* clientSocket, int chatId);
-    void getUserId(QTcpSocket* clientSocket, const QString& login);
+    QList<ChatListItem> getChatsForUser(int userId);
+    QStringList searchUsers(const QString& searchText, int offset, int limit);
+    MessagePage loadMessagePage(const MessageCursor& cursor, bool* ok = nullptr);
+    void getMessagesForChat(ClientConnection* client, const MessageCursor& cursor);
+    bool loadRecentMessages(int chatId);
+    static const int MaxPageSize = 500;
+    static const int HistoryChunkSize = 200; // Сообщений за один запрос при выдаче всей истории
+    static const int DefaultSearchResults = 50;
+    static const int MaxSearchResults = 500;
+    void getUserId(ClientConnection* client, const QString& login);
+    void processCreateChat(ClientConnection* client, const QString& chatName, const QString& chatType, const QString& userName1, const QString& userName2);
+    void processSendMessage(ClientConnection* client, int chatId, int userId, const QString& messageText);
+    void processGetChats(ClientConnection* client, int userId);
+    void processMarkRead(ClientConnection* client, int chatId, int userId, int messageId);
+    bool markRead(int chatId, int userId, int messageId);
+    void broadcastNewMessage(const ClientConnection* sender, int chatId, int userId, const StoredMessage& message, const QString& messageText);
+    UserRegistry& userRegistry() { return userSockets; }
+    DbExecutor* dbExecutor() const { return executor; }
+    IdentityCache* identityCache() const { return identities; }
+    MessageWriter* messageWriter() const { return writer; }
+    RecentMessageCache* recentMessageCache() const { return recentMessages; }
+    PasswordHasher* passwordHasher() const { return hasher; }
+    EventBus* eventBus() const { return bus; } // nullptr без --reuse-port
+    int connectionCount() const;
+    quint64 rejectedConnections() const; // Закрыты сразу: достигнут maxConnections
+    quint64 idleDisconnects() const;
 
 public slots:
-    void onNewConnection();
-    void processSearchRequest(QTcpSocket* clientSocket, const QString& searchText);
+    void processSearchRequest(ClientConnection* client, const QString& searchText, int offset, int limit);
     void addUserToChat(const int chatId, const int userId);
 
+protected:
+    void incomingConnection(qintptr socketDescriptor) override;
+
 private:
-    QHash<int, QTcpSocket*> userSockets;
-    QWidget* window;
-    QLabel* statusLabel;
-    QPushButton* logFileButton;
-    QVBoxLayout* layout;
-    unsigned int window_width = 450, window_height = 300;
-    QPlainTextEdit* logViewer;
-    QTimer* logUpdateTimer;
-    QString currentLogFilePath = QDir::homePath() + "/default_log.txt";
-    QLabel* logFileNameLabel;
-    void updateLogViewer();
-    void selectLogFile();
+    UserRegistry userSockets;
+    ReactorPool* reactors = nullptr;
+    Storage* storage = nullptr;
+    DbExecutor* executor = nullptr;
+    MessageWriter* writer = nullptr;
+    RecentMessageCache* recentMessages = nullptr;
+    PasswordHasher* hasher = nullptr;
+    StatsEndpoint* statsEndpoint = nullptr;
+    int metricsPort = 0;
+    bool reusePort = false;
+    EventBus* bus = nullptr;
+    bool listenReusePort(int port);
+    static void sendMessagePage(ClientConnection* client, const MessageCursor& cursor, const MessagePage& page);
+    static void writeMessageItem(ClientConnection* client, const ChatMessage& message);
+    void streamMessageHistory(ClientConnection* client, int chatId, int afterMessageId);
+    IdentityCache* identities = nullptr;
+    UserSearchIndex* searchIndex = nullptr;
 };
 
 #endif // SERVER_H
@@ -0,0 +1,266 @@
+#include "ServerWindow.h"
+#include "Server.h"
+#include "Logger.h"
+#include <QHeaderView>
+#include <QTextBlock>
+#include <QTextCursor>
+
+ServerWindow::ServerWindow(Server* server, QWidget *parent) : QWidget(parent), server(server) {
+    resize(window_width, window_height);
+    currentLogFilePath = Logger::getInstance()->logFilePath();
+
+    logFileNameLabel = new QLabel(tr("Файл логов: %1").arg(QFileInfo(currentLogFilePath).fileName()));
+    logFileNameLabel->setAlignment(Qt::AlignRight);
+    if (server->isListening()) {
+        statusLabel = new QLabel("Сервер работает.");
+        statusLabel->setStyleSheet("QLabel { color : green; }");
+    } else {
+        statusLabel = new QLabel("Сервер не запущен.");
+        statusLabel->setStyleSheet("QLabel { color : red; }");
+    }
+    statusLabel->setAlignment(Qt::AlignLeft);  // Выравнивание текста по центру
+    logViewer = new QPlainTextEdit();
+    logViewer->setReadOnly(true);
+    logViewer->setMaximumBlockCount(MaxLogLines);
+    logFileButton = new QPushButton("Выбрать файл для логгирования");
+    layout = new QVBoxLayout(this);
+
+    QHBoxLayout *headerLayout = new QHBoxLayout();
+    headerLayout->addWidget(logFileNameLabel);
+    headerLayout->addStretch();  // Добавление растяжения для разделения меток
+    headerLayout->addWidget(statusLabel);
+
+    loadLabel = new QLabel();
+
+    // Вкладка статистики: по строке на команду, значения за последний интервал
+    commandTable = new QTableWidget(int(Protocol::Command::Count), 7);
+    commandTable->setHorizontalHeaderLabels({tr("Команда"), tr("Запросов/с"), tr("Ошибок/с"), tr("p50, мс"),
+                                             tr("p99, мс"), tr("Приём, КБ/с"), tr("Отправка, КБ/с")});
+    commandTable->verticalHeader()->hide();
+    commandTable->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    commandTable->setSelectionMode(QAbstractItemView::NoSelection);
+    for (int row = 0; row < int(Protocol::Command::Count); ++row) {
+        commandTable->setItem(row, 0, new QTableWidgetItem(
+            QString::fromLatin1(Protocol::commandSpec(static_cast<Protocol::Command>(row))->name)));
+        for (int column = 1; column < commandTable->columnCount(); ++column) {
+            QTableWidgetItem* item = new QTableWidgetItem();
+            item->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
+            commandTable->setItem(row, column, item);
+        }
+    }
+    commandTable->resizeColumnsToContents();
+    QWidget* statsTab = new QWidget();
+    QVBoxLayout* statsLayout = new QVBoxLayout(statsTab);
+    statsLayout->addWidget(loadLabel);
+    statsLayout->addWidget(commandTable);
+
+    QWidget* logTab = new QWidget();
+    QVBoxLayout* logLayout = new QVBoxLayout(logTab);
+    logLayout->addWidget(logViewer);
+    logLayout->addWidget(logFileButton);
+
+    tabs = new QTabWidget();
+    tabs->addTab(statsTab, tr("Статистика"));
+    tabs->addTab(logTab, tr("Лог"));
+
+    previousMetrics.reset(new Metrics::Snapshot(Metrics::getInstance()->snapshot()));
+    sinceSnapshot.start();
+    updateLoad();
+
+    layout->addLayout(headerLayout);
+    layout->addWidget(tabs);
+
+    setLayout(layout);
+    setWindowTitle("Сервер");
+
+    connect(logFileButton, &QPushButton::clicked, this, &ServerWindow::selectLogFile);
+
+    logWatcher = new QFileSystemWatcher(this);
+    logChangeTimer = new QTimer(this);
+    logChangeTimer->setSingleShot(true);
+    connect(logChangeTimer, &QTimer::timeout, this, &ServerWindow::updateLogViewer);
+    connect(logWatcher, &QFileSystemWatcher::fileChanged, this, [this]() {
+        if (!logChangeTimer->isActive()) {
+            logChangeTimer->start(200);
+        }
+    });
+    connect(logViewer->verticalScrollBar(), &QScrollBar::valueChanged, this, &ServerWindow::onLogScrolled);
+    connect(tabs, &QTabWidget::currentChanged, this, &ServerWindow::updateLogViewer);
+    logTail.setPath(currentLogFilePath);
+    watchLogFile();
+    showLogTail();
+
+    logUpdateTimer = new QTimer(this);
+    connect(logUpdateTimer, &QTimer::timeout, this, &ServerWindow::updateLogViewer);
+    connect(logUpdateTimer, &QTimer::timeout, this, &ServerWindow::updateLoad);
+    connect(logUpdateTimer, &QTimer::timeout, this, &ServerWindow::updateCommandTable);
+    logUpdateTimer->start(1000);
+}
+
+void ServerWindow::updateLogViewer() {
+    if (tabs->currentIndex() != 1 || !followTail) {
+        return; // Файл дочитываем, только когда вкладка открыта и окно следит за концом
+    }
+    QStringList lines;
+    QVector<qint64> starts;
+    bool restarted = false;
+    logTail.poll(&lines, &starts, &restarted);
+    if (restarted) {
+        // Ротация или усечение: наблюдение переносим на новый файл
+        watchLogFile();
+        adjustingScroll = true;
+        logViewer->clear();
+        adjustingScroll = false;
+        lineStarts.clear();
+    }
+    appendLogLines(lines, starts);
+}
+
+void ServerWindow::watchLogFile() {
+    if (!logWatcher->files().isEmpty()) {
+        logWatcher->removePaths(logWatcher->files());
+    }
+    if (QFileInfo::exists(currentLogFilePath)) {
+        logWatcher->addPath(currentLogFilePath);
+    }
+}
+
+void ServerWindow::appendLogLines(const QStringList& lines, const QVector<qint64>& starts) {
+    if (lines.isEmpty()) {
+        return;
+    }
+    QScrollBar* scrollBar = logViewer->verticalScrollBar();
+    const bool atBottom = scrollBar->value() == scrollBar->maximum();
+    adjustingScroll = true;
+    // Одна вставка на пачку; лишние строки сверху срезает setMaximumBlockCount
+    logViewer->appendPlainText(lines.join('\n'));
+    for (qint64 start : starts) {
+        lineStarts.enqueue(start);
+    }
+    while (lineStarts.size() > logViewer->blockCount()) {
+        lineStarts.dequeue();
+    }
+    if (atBottom) {
+        scrollBar->setValue(scrollBar->maximum());
+    }
+    adjustingScroll = false;
+}
+
+void ServerWindow::showLogTail() {
+    QStringList lines;
+    QVector<qint64> starts;
+    logTail.readTail(TailLines, &lines, &starts);
+    followTail = true;
+    adjustingScroll = true;
+    logViewer->setMaximumBlockCount(MaxLogLines);
+    logViewer->setPlainText(lines.join('\n'));
+    lineStarts.clear();
+    for (qint64 start : starts) {
+        lineStarts.enqueue(start);
+    }
+    QScrollBar* scrollBar = logViewer->verticalScrollBar();
+    scrollBar->setValue(scrollBar->maximum());
+    adjustingScroll = false;
+}
+
+void ServerWindow::loadOlderLogLines() {
+    if (lineStarts.isEmpty() || lineStarts.head() == 0) {
+        return; // Уже показано начало файла
+    }
+    QStringList lines;
+    QVector<qint64> starts;
+    logTail.readBefore(lineStarts.head(), ScrollbackLines, &lines, &starts);
+    if (lines.isEmpty()) {
+        return;
+    }
+    // Окно больше не показывает конец файла: новые строки не дописываем,
+    // а снизу срезаем столько же, сколько добавили сверху
+    followTail = false;
+    adjustingScroll = true;
+    logViewer->setMaximumBlockCount(0);
+    QTextCursor cursor(logViewer->document());
+    cursor.movePosition(QTextCursor::Start);
+    cursor.insertText(lines.join('\n') + '\n');
+    for (int i = starts.size() - 1; i >= 0; --i) {
+        lineStarts.prepend(starts.at(i));
+    }
+    if (logViewer->blockCount() > MaxLogLines) {
+        QTextBlock last = logViewer->document()->findBlockByNumber(MaxLogLines - 1);
+        cursor.setPosition(last.position() + last.length() - 1);
+        cursor.movePosition(QTextCursor::End, QTextCursor::KeepAnchor);
+        cursor.removeSelectedText();
+    }
+    while (lineStarts.size() > logViewer->blockCount()) {
+        lineStarts.removeLast();
+    }
+    // Строка, которая была наверху, остаётся на месте
+    logViewer->verticalScrollBar()->setValue(lines.size());
+    adjustingScroll = false;
+}
+
+void ServerWindow::onLogScrolled(int value) {
+    if (adjustingScroll) {
+        return;
+    }
+    QScrollBar* scrollBar = logViewer->verticalScrollBar();
+    if (value == scrollBar->minimum()) {
+        loadOlderLogLines();
+    } else if (value == scrollBar->maximum() && !followTail) {
+        showLogTail();
+    }
+}
+
+void ServerWindow::updateLoad() {
+    DbExecutor* executor = server->dbExecutor();
+    IdentityCache* identities = server->identityCache();
+    RecentMessageCache* recent = server->recentMessageCache();
+    const quint64 lookups = identities->hits() + identities->misses();
+    QString load = tr("Подключений: %1, очередь БД: %2/%3, отклонено: %4, кэш логинов: %5%")
+                   .arg(server->connectionCount())
+                   .arg(executor->queueDepth())
+                   .arg(executor->queueCapacity())
+                   .arg(executor->rejectedCount())
+                   .arg(lookups ? identities->hits() * 100 / lookups : 0);
+    if (recent) {
+        const quint64 pageReads = recent->hits() + recent->misses();
+        load += "\n" + tr("Кэш сообщений: %1% попаданий, %2 чатов, %3/%4 МБ")
+                        .arg(pageReads ? recent->hits() * 100 / pageReads : 0)
+                        .arg(recent->chatCount())
+                        .arg(recent->memoryUsed() / (1024.0 * 1024.0), 0, 'f', 1)
+                        .arg(recent->memoryBudget() / (1024 * 1024));
+    } else {
+        load += "\n" + tr("Кэш сообщений выключен");
+    }
+    loadLabel->setText(load);
+}
+
+void ServerWindow::updateCommandTable() {
+    std::unique_ptr<Metrics::Snapshot> current(new Metrics::Snapshot(Metrics::getInstance()->snapshot()));
+    const double seconds = qMax<qint64>(1, sinceSnapshot.restart()) / 1000.0;
+    for (int row = 0; row < int(Protocol::Command::Count); ++row) {
+        const Metrics::CommandSnapshot& now = current->commands[row];
+        const Metrics::CommandSnapshot& before = previousMetrics->commands[row];
+        Metrics::HistogramSnapshot latency = now.latency;
+        latency.subtract(before.latency);
+        commandTable->item(row, 1)->setText(QString::number((now.count - before.count) / seconds, 'f', 1));
+        commandTable->item(row, 2)->setText(QString::number((now.errors - before.errors) / seconds, 'f', 1));
+        commandTable->item(row, 3)->setText(latency.count ? QString::number(latency.percentile(0.5) / 1000.0, 'f', 2) : "-");
+        commandTable->item(row, 4)->setText(latency.count ? QString::number(latency.percentile(0.99) / 1000.0, 'f', 2) : "-");
+        commandTable->item(row, 5)->setText(QString::number((now.bytesIn - before.bytesIn) / 1024.0 / seconds, 'f', 1));
+        commandTable->item(row, 6)->setText(QString::number((now.bytesOut - before.bytesOut) / 1024.0 / seconds, 'f', 1));
+    }
+    previousMetrics = std::move(current);
+}
+
+void ServerWindow::selectLogFile() {
+    QString filename = QFileDialog::getOpenFileName(this, tr("Открыть файл"), QDir::homePath(), tr("Log Files (*.txt)"));
+    if(!filename.isEmpty()) {
+        Logger::getInstance()->setLogFile(filename);
+        currentLogFilePath = filename;
+        logTail.setPath(filename);
+        watchLogFile();
+        showLogTail();  // Сразу обновляем содержимое лога в интерфейсе
+        // Здесь же обновляем надпись с именем файла логов
+        logFileNameLabel->setText(tr("Файл логов: %1").arg(QFileInfo(filename).fileName()));
+    }
+}
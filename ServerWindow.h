@@ -0,0 +1,75 @@
+#ifndef SERVERWINDOW_H
+#define SERVERWINDOW_H
+
+#include <QWidget>
+#include <QLabel>
+#include <QPushButton>
+#include <QVBoxLayout>
+#include <QFileDialog>
+#include <QPlainTextEdit>
+#include <QFormLayout>
+#include <QTimer>
+#include <QScrollBar>
+#include <QDir>
+#include <QTabWidget>
+#include <QTableWidget>
+#include <QElapsedTimer>
+#include <QFileSystemWatcher>
+#include <QQueue>
+#include <memory>
+#include "Metrics.h"
+#include "LogTail.h"
+
+class Server;
+
+// Необязательный графический фронтенд: подключается к уже запущенному
+// ядру Server и показывает состояние сервера, статистику команд за
+// последнюю секунду и содержимое файла логов.
+//
+// Лог показывается как tail -f: дочитываются только новые строки (по
+// QFileSystemWatcher и раз в секунду), в окне не больше MaxLogLines строк.
+// При прокрутке к началу более ранние строки подгружаются из файла через
+// отображение в память; прокрутка в конец снова включает слежение.
+class ServerWindow : public QWidget {
+    Q_OBJECT
+
+public:
+    explicit ServerWindow(Server* server, QWidget *parent = nullptr);
+
+private:
+    Server* server;
+    QLabel* statusLabel;
+    QPushButton* logFileButton;
+    QVBoxLayout* layout;
+    unsigned int window_width = 700, window_height = 450;
+    QTabWidget* tabs;
+    QTableWidget* commandTable;
+    QPlainTextEdit* logViewer;
+    QTimer* logUpdateTimer;
+    QString currentLogFilePath;
+    QLabel* logFileNameLabel;
+    QLabel* loadLabel;
+    // Предыдущий снимок метрик: скорости и перцентили считаются по разнице
+    std::unique_ptr<Metrics::Snapshot> previousMetrics;
+    QElapsedTimer sinceSnapshot;
+    LogTail logTail;
+    QFileSystemWatcher* logWatcher;
+    QTimer* logChangeTimer;          // Склеивает частые fileChanged в одно чтение
+    QQueue<qint64> lineStarts;       // Смещения в файле строк, видимых в окне
+    bool followTail = true;          // Окно показывает конец файла и дописывает новые строки
+    bool adjustingScroll = false;
+    static const int MaxLogLines = 5000;
+    static const int TailLines = 1000;
+    static const int ScrollbackLines = 500;
+    void updateLogViewer();
+    void appendLogLines(const QStringList& lines, const QVector<qint64>& starts);
+    void showLogTail();
+    void loadOlderLogLines();
+    void onLogScrolled(int value);
+    void watchLogFile();
+    void updateLoad();
+    void updateCommandTable();
+    void selectLogFile();
+};
+
+#endif // SERVERWINDOW_H
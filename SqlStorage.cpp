@@ -0,0 +1,535 @@
+#include "SqlStorage.h"
+#include <QHash>
+#include <QThread>
+#include <QDebug>
+#include <algorithm>
+#include <limits>
+
+SqlStorage::SqlStorage(const QString& driver) : driver(driver)
+{
+}
+
+SqlStorage::~SqlStorage()
+{
+    SqlStorage::releaseThread();
+}
+
+SqlStorage::Query::Query(SqlStorage* storage, Statement statement)
+{
+    ThreadConnection* state = storage->threadConnection();
+    if (state != nullptr && state->queries.at(statement) != nullptr)
+    {
+        query = state->queries.at(statement);
+        return;
+    }
+    query = new QSqlQuery(state != nullptr ? QSqlDatabase::database(state->name, false) : QSqlDatabase());
+    query->setForwardOnly(true);
+    if (query->prepare(storage->sql(statement)) && state != nullptr)
+    {
+        state->queries[statement] = query;
+    }
+    else
+    {
+        owned = true; // exec() вернёт ошибку подготовки; в следующий раз подготовим заново
+    }
+}
+
+SqlStorage::Query::~Query()
+{
+    if (owned)
+    {
+        delete query;
+    }
+    else
+    {
+        query->finish();
+    }
+}
+
+SqlStorage::ThreadConnection* SqlStorage::threadConnection()
+{
+    if (threads.hasLocalData() && threads.localData() != nullptr)
+    {
+        return threads.localData();
+    }
+    if (!acquireConnection())
+    {
+        return nullptr;
+    }
+    ThreadConnection* state = new ThreadConnection;
+    state->name = QString("messenger-%1-%2").arg(driver)
+                      .arg(reinterpret_cast<quintptr>(QThread::currentThreadId()), 0, 16);
+    state->queries.fill(nullptr, StatementCount);
+    QSqlDatabase db = QSqlDatabase::addDatabase(driver, state->name);
+    configure(db);
+    if (db.open())
+    {
+        connected(db);
+    }
+    else
+    {
+        qCritical() << "Could not connect to database:" << db.lastError().text();
+    }
+    threads.setLocalData(state);
+    return state;
+}
+
+QSqlDatabase SqlStorage::connection()
+{
+    ThreadConnection* state = threadConnection();
+    return state != nullptr ? QSqlDatabase::database(state->name, false) : QSqlDatabase();
+}
+
+bool SqlStorage::open()
+{
+    QSqlDatabase db = connection();
+    if (!db.isOpen())
+    {
+        return false;
+    }
+    return createSchema(db);
+}
+
+void SqlStorage::attachThread()
+{
+    threadConnection();
+}
+
+void SqlStorage::releaseThread()
+{
+    if (!threads.hasLocalData() || threads.localData() == nullptr)
+    {
+        return;
+    }
+    ThreadConnection* state = threads.localData();
+    const QString name = state->name;
+    qDeleteAll(state->queries); // Запросы должны умереть раньше соединения
+    state->queries.clear();
+    {
+        QSqlDatabase db = QSqlDatabase::database(name, false);
+        db.close();
+    }
+    QSqlDatabase::removeDatabase(name);
+    threads.setLocalData(nullptr); // Удаляет state
+    releaseConnection();
+}
+
+int SqlStorage::insertedId(QSqlQuery& query) const
+{
+    return query.lastInsertId().toInt();
+}
+
+QString SqlStorage::sql(Statement statement) const
+{
+    // Общая часть запросов к messages; порядок столбцов разбирает loadMessagePage
+    const QString messageColumns = QString("SELECT message_id, user_id, message_text, %1 "
+                                           "FROM messages WHERE chat_id = :chatId ")
+                                       .arg(epochSeconds("timestamp_sent"));
+    switch (statement)
+    {
+    case FindUser:
+        return "SELECT user_id FROM user_auth WHERE login = :login";
+    case FindCredentials:
+        return "SELECT user_id, password FROM user_auth WHERE login = :login";
+    case UpdatePassword:
+        return "UPDATE user_auth SET password = :password WHERE user_id = :user_id";
+    case ListUsers:
+        return "SELECT login, user_id FROM user_auth ORDER BY user_id LIMIT :limit";
+    case AddParticipant:
+        return "INSERT INTO chat_participants (chat_id, user_id) VALUES (:chat_id, :user_id)";
+    case ChatExists:
+        return "SELECT chat_id FROM chat_participants WHERE user_id = :userId1 "
+               "INTERSECT "
+               "SELECT chat_id FROM chat_participants WHERE user_id = :userId2";
+    case ChatParticipants:
+        return "SELECT user_id FROM chat_participants WHERE chat_id = :chat_id";
+    case ChatsForUser:
+        // Чаты пользователя по индексу участников, последнее сообщение и счётчик
+        // непрочитанных - готовыми строками сводок: O(число чатов)
+        return "SELECT me.chat_id, ua.login, COALESCE(r.unread_count, 0), COALESCE(s.last_message_id, 0), "
+               "COALESCE(s.last_sender_id, 0), COALESCE(s.last_timestamp, 0), COALESCE(s.last_message_text, '') "
+               "FROM chat_participants me "
+               "JOIN chat_participants peer ON peer.chat_id = me.chat_id AND peer.user_id != me.user_id "
+               "JOIN user_auth ua ON ua.user_id = peer.user_id "
+               "LEFT JOIN chat_summaries s ON s.chat_id = me.chat_id "
+               "LEFT JOIN chat_read_markers r ON r.chat_id = me.chat_id AND r.user_id = me.user_id "
+               "WHERE me.user_id = :user_id "
+               "ORDER BY COALESCE(s.last_message_id, 0) DESC, me.chat_id DESC";
+    case MarkRead:
+        // Непрочитанные пересчитываются по индексу (chat_id, message_id) - это
+        // число сообщений после отметки, а не вся история чата
+        return "UPDATE chat_read_markers SET last_read_message_id = :message_id, "
+               "unread_count = (SELECT COUNT(*) FROM messages WHERE chat_id = :chat_id "
+               "AND message_id > :message_id AND user_id != :user_id) "
+               "WHERE chat_id = :chat_id AND user_id = :user_id AND last_read_message_id < :message_id";
+    case ReadMarkerExists:
+        return "SELECT 1 FROM chat_read_markers WHERE chat_id = :chat_id AND user_id = :user_id";
+    // Все три страницы идут по индексу (chat_id, message_id): стоимость зависит
+    // от размера страницы, а не от длины истории чата
+    case LatestMessages:
+        return messageColumns + "ORDER BY message_id DESC LIMIT :limit";
+    case MessagesBefore:
+        return messageColumns + "AND message_id < :cursor ORDER BY message_id DESC LIMIT :limit";
+    case MessagesAfter:
+        return messageColumns + "AND message_id > :cursor ORDER BY message_id ASC LIMIT :limit";
+    case CountUnread:
+        // Непрочитанные у остальных участников растут, отправитель своё прочитал
+        return "UPDATE chat_read_markers SET unread_count = unread_count + 1 "
+               "WHERE chat_id = :chatId AND user_id != :userId";
+    case SenderRead:
+        return "UPDATE chat_read_markers SET last_read_message_id = :messageId, unread_count = 0 "
+               "WHERE chat_id = :chatId AND user_id = :userId";
+    default:
+        break;
+    }
+    qCritical() << "No SQL for statement" << statement;
+    return QString();
+}
+
+int SqlStorage::findUser(const QString& login, bool* ok)
+{
+    Query query(this, FindUser);
+    query->bindValue(":login", login);
+    *ok = query->exec();
+    if (!*ok)
+    {
+        qCritical() << "Failed to find user_id:" << query->lastError().text();
+        return -1;
+    }
+    return query->next() ? query->value(0).toInt() : -1;
+}
+
+int SqlStorage::addUser(const QString& login, const QString& passwordHash)
+{
+    Query query(this, AddUser);
+    query->bindValue(":login", login);
+    query->bindValue(":password", passwordHash);
+    if (!query->exec())
+    {
+        qCritical() << "Failed to add user to database:" << query->lastError().text();
+        return -1;
+    }
+    return insertedId(*query);
+}
+
+int SqlStorage::findCredentials(const QString& login, QString* storedPassword)
+{
+    Query query(this, FindCredentials);
+    query->bindValue(":login", login);
+    if (!query->exec())
+    {
+        qCritical() << "Failed to check user credentials:" << query->lastError().text();
+        return -1;
+    }
+    if (!query->next())
+    {
+        return -1;
+    }
+    *storedPassword = query->value(1).toString();
+    return query->value(0).toInt();
+}
+
+bool SqlStorage::updatePasswordHash(int userId, const QString& passwordHash)
+{
+    Query query(this, UpdatePassword);
+    query->bindValue(":password", passwordHash);
+    query->bindValue(":user_id", userId);
+    if (!query->exec())
+    {
+        qCritical() << "Failed to update password hash:" << query->lastError().text();
+        return false;
+    }
+    return true;
+}
+
+int SqlStorage::forEachUser(int limit, const UserVisitor& visit)
+{
+    Query query(this, ListUsers);
+    query->bindValue(":limit", limit < 0 ? std::numeric_limits<int>::max() : limit);
+    if (!query->exec())
+    {
+        qCritical() << "Failed to load users:" << query->lastError().text();
+        return 0;
+    }
+    int visited = 0;
+    while (query->next())
+    {
+        visit(query->value(0).toString(), query->value(1).toInt());
+        ++visited;
+    }
+    return visited;
+}
+
+int SqlStorage::createChat(const QString& chatName, const QString& chatType)
+{
+    Query query(this, CreateChat);
+    query->bindValue(":chat_name", chatName);
+    query->bindValue(":chat_type", chatType);
+    if (!query->exec())
+    {
+        qCritical() << "Failed to create chat:" << query->lastError().text();
+        return -1;
+    }
+    return insertedId(*query);
+}
+
+bool SqlStorage::addParticipant(int chatId, int userId)
+{
+    {
+        Query query(this, AddParticipant);
+        query->bindValue(":chat_id", chatId);
+        query->bindValue(":user_id", userId);
+        if (!query->exec())
+        {
+            qCritical() << "Failed to add user to chat:" << query->lastError().text();
+            return false;
+        }
+    }
+    // Строка счётчика непрочитанных нужна appendMessages и chatsForUser
+    Query marker(this, AddReadMarker);
+    marker->bindValue(":chat_id", chatId);
+    marker->bindValue(":user_id", userId);
+    if (!marker->exec())
+    {
+        qCritical() << "Failed to create read marker:" << marker->lastError().text();
+    }
+    return true;
+}
+
+bool SqlStorage::chatExistsBetween(int userId1, int userId2)
+{
+    Query query(this, ChatExists);
+    query->bindValue(":userId1", userId1);
+    query->bindValue(":userId2", userId2);
+    return query->exec() && query->next();
+}
+
+QVector<int> SqlStorage::chatParticipants(int chatId)
+{
+    QVector<int> participants;
+    Query query(this, ChatParticipants);
+    query->bindValue(":chat_id", chatId);
+    if (!query->exec())
+    {
+        qCritical() << "Failed to get chat participants:" << query->lastError().text();
+        return participants;
+    }
+    while (query->next())
+    {
+        participants.append(query->value(0).toInt());
+    }
+    return participants;
+}
+
+QList<ChatListItem> SqlStorage::chatsForUser(int userId)
+{
+    QList<ChatListItem> chats;
+    Query query(this, ChatsForUser);
+    query->bindValue(":user_id", userId);
+    if (!query->exec())
+    {
+        qCritical() << "Failed to get chats for user:" << query->lastError().text();
+        return chats;
+    }
+    while (query->next())
+    {
+        ChatListItem chat;
+        chat.chatId = query->value(0).toInt();
+        chat.peerLogin = query->value(1).toString();
+        chat.unreadCount = query->value(2).toInt();
+        chat.lastMessage.messageId = query->value(3).toInt();
+        chat.lastMessage.senderId = query->value(4).toInt();
+        chat.lastMessage.timestamp = query->value(5).toLongLong();
+        chat.lastMessage.text = query->value(6).toString();
+        chats.append(chat);
+    }
+    return chats;
+}
+
+bool SqlStorage::markRead(int chatId, int userId, int messageId)
+{
+    {
+        Query query(this, MarkRead);
+        query->bindValue(":message_id", messageId);
+        query->bindValue(":chat_id", chatId);
+        query->bindValue(":user_id", userId);
+        if (!query->exec())
+        {
+            qCritical() << "Failed to mark chat as read:" << query->lastError().text();
+            return false;
+        }
+        if (query->numRowsAffected() > 0)
+        {
+            return true;
+        }
+    }
+    // Отметка уже дальше - тоже успех; нет строки - пользователь не в чате
+    Query query(this, ReadMarkerExists);
+    query->bindValue(":chat_id", chatId);
+    query->bindValue(":user_id", userId);
+    return query->exec() && query->next();
+}
+
+MessagePage SqlStorage::loadMessagePage(const MessageCursor& cursor, bool* ok)
+{
+    MessagePage page;
+    Statement statement = LatestMessages;
+    switch (cursor.direction)
+    {
+    case MessageCursor::Latest:
+        statement = LatestMessages;
+        break;
+    case MessageCursor::Before:
+        statement = MessagesBefore;
+        break;
+    case MessageCursor::After:
+        statement = MessagesAfter;
+        break;
+    }
+    Query query(this, statement);
+    query->bindValue(":chatId", cursor.chatId);
+    if (cursor.direction != MessageCursor::Latest)
+    {
+        query->bindValue(":cursor", cursor.messageId);
+    }
+    query->bindValue(":limit", cursor.limit + 1); // Лишняя строка показывает, есть ли продолжение
+    *ok = query->exec();
+    if (!*ok)
+    {
+        qCritical() << "Failed to get messages for chat:" << query->lastError().text();
+        return page;
+    }
+    while (query->next())
+    {
+        if (page.messages.size() == cursor.limit)
+        {
+            page.hasMore = true;
+            break;
+        }
+        ChatMessage message;
+        message.messageId = query->value(0).toInt();
+        message.senderId = query->value(1).toInt(); // ID пользователя отправившего сообщение
+        message.text = query->value(2).toString();
+        message.timestamp = query->value(3).toLongLong();
+        page.messages.append(message);
+    }
+    if (cursor.direction != MessageCursor::After)
+    {
+        std::reverse(page.messages.begin(), page.messages.end());
+    }
+    return page;
+}
+
+void SqlStorage::appendMessages(const QVector<NewMessage>& batch, const QDateTime& sentAt,
+                                QVector<StoredMessage>* results)
+{
+    results->resize(batch.size());
+    QSqlDatabase db = connection();
+    // Время в формате CURRENT_TIMESTAMP: кэш последних сообщений хранит то же значение, что и база
+    const QString sentAtText = sentAt.toString("yyyy-MM-dd HH:mm:ss");
+    if (!db.transaction())
+    {
+        const QString error = db.lastError().text();
+        for (StoredMessage& result : *results)
+        {
+            result.error = error;
+        }
+        return;
+    }
+    QString batchError; // Не пусто - транзакцию нельзя фиксировать
+    {
+        Query insert(this, InsertMessage);
+        Query unread(this, CountUnread);
+        Query senderRead(this, SenderRead);
+        // В PostgreSQL любая ошибка обрывает транзакцию целиком, и COMMIT
+        // молча превращается в ROLLBACK. Поэтому каждое сообщение пишется
+        // под своей точкой сохранения: ошибка откатывает только его, а
+        // остальная партия фиксируется. SAVEPOINT нельзя подготовить
+        // (PREPARE в PostgreSQL его не принимает), он выполняется как есть.
+        QSqlQuery savepoint(db);
+        QHash<int, int> lastInChat; // chat_id -> индекс последнего сообщения партии
+        for (int i = 0; i < batch.size() && batchError.isEmpty(); ++i)
+        {
+            if (!savepoint.exec("SAVEPOINT message"))
+            {
+                batchError = savepoint.lastError().text();
+                break;
+            }
+            const NewMessage& message = batch.at(i);
+            QString error;
+            int messageId = -1;
+            insert->bindValue(":chatId", message.chatId);
+            insert->bindValue(":userId", message.userId);
+            insert->bindValue(":messageText", message.text);
+            insert->bindValue(":timestampSent", sentAtText);
+            if (!insert->exec())
+            {
+                error = insert->lastError().text();
+            }
+            else
+            {
+                messageId = insertedId(*insert);
+                insert->finish();
+                unread->bindValue(":chatId", message.chatId);
+                unread->bindValue(":userId", message.userId);
+                senderRead->bindValue(":messageId", messageId);
+                senderRead->bindValue(":chatId", message.chatId);
+                senderRead->bindValue(":userId", message.userId);
+                if (!unread->exec())
+                {
+                    error = unread->lastError().text();
+                }
+                else if (!senderRead->exec())
+                {
+                    error = senderRead->lastError().text();
+                }
+            }
+            if (error.isEmpty())
+            {
+                (*results)[i].messageId = messageId;
+                lastInChat.insert(message.chatId, i);
+                if (!savepoint.exec("RELEASE SAVEPOINT message"))
+                {
+                    batchError = savepoint.lastError().text();
+                }
+                continue;
+            }
+            // Сообщение не сохраняется вместе со своими счётчиками
+            qCritical() << "Failed to store message in chat" << message.chatId << ":" << error;
+            (*results)[i].error = error;
+            if (!savepoint.exec("ROLLBACK TO SAVEPOINT message") || !savepoint.exec("RELEASE SAVEPOINT message"))
+            {
+                batchError = savepoint.lastError().text();
+            }
+        }
+        // Сводка чата хранит только последнее сообщение: одна запись на чат за партию
+        Query summary(this, UpdateSummary);
+        for (QHash<int, int>::const_iterator it = lastInChat.constBegin();
+             it != lastInChat.constEnd() && batchError.isEmpty(); ++it)
+        {
+            summary->bindValue(":chatId", it.key());
+            summary->bindValue(":messageId", results->at(it.value()).messageId);
+            summary->bindValue(":senderId", batch.at(it.value()).userId);
+            summary->bindValue(":messageText", batch.at(it.value()).text);
+            summary->bindValue(":timestamp", sentAt.toSecsSinceEpoch());
+            if (!summary->exec())
+            {
+                batchError = summary->lastError().text();
+            }
+        }
+    }
+    if (batchError.isEmpty() && !db.commit())
+    {
+        batchError = db.lastError().text();
+    }
+    if (!batchError.isEmpty())
+    {
+        qCritical() << "Failed to store message batch:" << batchError;
+        db.rollback();
+        for (StoredMessage& result : *results)
+        {
+            result.error = batchError;
+            result.messageId = -1;
+        }
+    }
+}
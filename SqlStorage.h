@@ -0,0 +1,119 @@
+#ifndef SQLSTORAGE_H
+#define SQLSTORAGE_H
+
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QThreadStorage>
+#include <QVector>
+#include "Storage.h"
+
+// Общая часть SQL-хранилищ (SQLite и PostgreSQL). QSqlDatabase нельзя
+// использовать из нескольких потоков, поэтому у каждого потока своё
+// именованное соединение; оно открывается при первом обращении из потока
+// (или в attachThread) и закрывается в releaseThread.
+// Запросы готовятся один раз на соединение и дальше только получают новые
+// значения параметров. Наследник задаёт драйвер, параметры соединения,
+// схему и те запросы, которые отличаются в его диалекте SQL.
+class SqlStorage : public Storage
+{
+public:
+    ~SqlStorage();
+
+    bool open() override;
+    void attachThread() override;
+    void releaseThread() override;
+
+    int findUser(const QString& login, bool* ok) override;
+    int addUser(const QString& login, const QString& passwordHash) override;
+    int findCredentials(const QString& login, QString* storedPassword) override;
+    bool updatePasswordHash(int userId, const QString& passwordHash) override;
+    int forEachUser(int limit, const UserVisitor& visit) override;
+
+    int createChat(const QString& chatName, const QString& chatType) override;
+    bool addParticipant(int chatId, int userId) override;
+    bool chatExistsBetween(int userId1, int userId2) override;
+    QVector<int> chatParticipants(int chatId) override;
+    QList<ChatListItem> chatsForUser(int userId) override;
+    bool markRead(int chatId, int userId, int messageId) override;
+
+    MessagePage loadMessagePage(const MessageCursor& cursor, bool* ok) override;
+    void appendMessages(const QVector<NewMessage>& batch, const QDateTime& sentAt,
+                        QVector<StoredMessage>* results) override;
+
+protected:
+    enum Statement
+    {
+        FindUser,
+        AddUser,
+        FindCredentials,
+        UpdatePassword,
+        ListUsers,
+        CreateChat,
+        AddParticipant,
+        AddReadMarker,
+        ChatExists,
+        ChatParticipants,
+        ChatsForUser,
+        MarkRead,
+        ReadMarkerExists,
+        LatestMessages,
+        MessagesBefore,
+        MessagesAfter,
+        InsertMessage,
+        CountUnread,
+        SenderRead,
+        UpdateSummary,
+        StatementCount
+    };
+
+    explicit SqlStorage(const QString& driver);
+
+    // Текст запроса. Здесь - запросы, одинаковые для всех диалектов;
+    // наследник отвечает за остальные и вызывает эту реализацию по умолчанию.
+    virtual QString sql(Statement statement) const;
+    // Выражение "секунды с начала эпохи" для столбца с временем.
+    virtual QString epochSeconds(const QString& column) const = 0;
+    // Параметры нового соединения перед open().
+    virtual void configure(QSqlDatabase& db) const = 0;
+    // Вызывается после открытия каждого соединения (PRAGMA и т.п.).
+    virtual void connected(QSqlDatabase) const {}
+    virtual bool createSchema(QSqlDatabase db) = 0;
+    // id строки, вставленной запросом AddUser, CreateChat или InsertMessage.
+    virtual int insertedId(QSqlQuery& query) const;
+    // Потоку нужно новое соединение / поток его вернул. false - соединения нет.
+    virtual bool acquireConnection() { return true; }
+    virtual void releaseConnection() {}
+
+    // Соединение текущего потока (открывается при первом вызове).
+    QSqlDatabase connection();
+
+private:
+    struct ThreadConnection
+    {
+        QString name;
+        QVector<QSqlQuery*> queries; // Подготовленные запросы по Statement
+    };
+
+    // Подготовленный запрос текущего потока. При выходе из области видимости
+    // сбрасывается, чтобы недочитанный SELECT не держал читающую транзакцию.
+    class Query
+    {
+    public:
+        Query(SqlStorage* storage, Statement statement);
+        ~Query();
+        QSqlQuery* operator->() const { return query; }
+        QSqlQuery& operator*() const { return *query; }
+
+    private:
+        QSqlQuery* query;
+        bool owned = false; // Не подготовился и не попал в кэш соединения
+    };
+
+    ThreadConnection* threadConnection();
+
+    QString driver;
+    QThreadStorage<ThreadConnection*> threads;
+};
+
+#endif // SQLSTORAGE_H
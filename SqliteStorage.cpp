@@ -0,0 +1,159 @@
+#include "SqliteStorage.h"
+#include <QDebug>
+
+SqliteStorage::SqliteStorage(const QString& path) : SqlStorage("QSQLITE"), path(path)
+{
+}
+
+QString SqliteStorage::description() const
+{
+    return QString("SQLite database %1").arg(path);
+}
+
+QString SqliteStorage::sql(Statement statement) const
+{
+    switch (statement)
+    {
+    case AddUser:
+        return "INSERT INTO user_auth (login, password) VALUES (:login, :password)";
+    case CreateChat:
+        return "INSERT INTO chats (chat_name, chat_type) VALUES (:chat_name, :chat_type)";
+    case AddReadMarker:
+        return "INSERT OR IGNORE INTO chat_read_markers (chat_id, user_id) VALUES (:chat_id, :user_id)";
+    case InsertMessage:
+        return "INSERT INTO messages (chat_id, user_id, message_text, timestamp_sent) "
+               "VALUES (:chatId, :userId, :messageText, :timestampSent)";
+    case UpdateSummary:
+        return "INSERT OR REPLACE INTO chat_summaries "
+               "(chat_id, last_message_id, last_sender_id, last_message_text, last_timestamp) "
+               "VALUES (:chatId, :messageId, :senderId, :messageText, :timestamp)";
+    default:
+        return SqlStorage::sql(statement);
+    }
+}
+
+QString SqliteStorage::epochSeconds(const QString& column) const
+{
+    return QString("CAST(strftime('%s', %1) AS INTEGER)").arg(column);
+}
+
+void SqliteStorage::configure(QSqlDatabase& db) const
+{
+    db.setDatabaseName(path);
+    // Несколько соединений пишут в один файл: ждём блокировку, а не падаем сразу
+    db.setConnectOptions("QSQLITE_BUSY_TIMEOUT=5000");
+}
+
+void SqliteStorage::connected(QSqlDatabase db) const
+{
+    // WAL: читатели не блокируют писателя, а коммит - это дозапись в журнал.
+    // synchronous=FULL оставлен ради гарантии "подтверждено - значит на диске";
+    // стоимость fsync делится на всю партию MessageWriter.
+    static const char* const pragmas[] = {
+        "PRAGMA journal_mode=WAL",
+        "PRAGMA synchronous=FULL",
+        "PRAGMA cache_size=-16000", // 16 МБ страничного кэша на соединение
+        "PRAGMA temp_store=MEMORY",
+    };
+    QSqlQuery query(db);
+    for (const char* pragma : pragmas)
+    {
+        if (!query.exec(pragma))
+        {
+            qWarning() << "Failed to apply" << pragma << ":" << query.lastError().text();
+        }
+    }
+}
+
+bool SqliteStorage::createSchema(QSqlDatabase db)
+{
+    // На пустой базе (новая установка, нагрузочный прогон) создаём таблицы сами
+    static const char* const tables[] = {
+        "CREATE TABLE IF NOT EXISTS user_auth (user_id INTEGER PRIMARY KEY AUTOINCREMENT, "
+        "login TEXT NOT NULL UNIQUE, password TEXT NOT NULL)",
+        "CREATE TABLE IF NOT EXISTS chats (chat_id INTEGER PRIMARY KEY AUTOINCREMENT, "
+        "chat_name TEXT, chat_type TEXT)",
+        "CREATE TABLE IF NOT EXISTS chat_participants (chat_id INTEGER NOT NULL, user_id INTEGER NOT NULL, "
+        "PRIMARY KEY (chat_id, user_id))",
+        "CREATE TABLE IF NOT EXISTS messages (message_id INTEGER PRIMARY KEY AUTOINCREMENT, "
+        "chat_id INTEGER NOT NULL, user_id INTEGER NOT NULL, message_text TEXT, "
+        "timestamp_sent DATETIME DEFAULT CURRENT_TIMESTAMP)",
+    };
+    // Постраничный get_messages и выборка по времени опираются на эти индексы
+    static const char* const indexes[] = {
+        "CREATE INDEX IF NOT EXISTS idx_messages_chat_message ON messages (chat_id, message_id)",
+        "CREATE INDEX IF NOT EXISTS idx_messages_chat_time ON messages (chat_id, timestamp_sent)",
+        // Список чатов пользователя и собеседники в нём
+        "CREATE INDEX IF NOT EXISTS idx_chat_participants_user ON chat_participants (user_id, chat_id)",
+        "CREATE INDEX IF NOT EXISTS idx_chat_participants_chat ON chat_participants (chat_id, user_id)",
+    };
+    QSqlQuery query(db);
+    for (const char* statement : tables)
+    {
+        if (!query.exec(statement))
+        {
+            qCritical() << "Failed to create table:" << query.lastError().text();
+            return false;
+        }
+    }
+    for (const char* statement : indexes)
+    {
+        if (!query.exec(statement))
+        {
+            qCritical() << "Failed to create index:" << query.lastError().text();
+        }
+    }
+    createChatSummaries(db);
+    return true;
+}
+
+// Сводки чатов и отметки о прочтении обновляются при каждой записи
+// (appendMessages) и mark_read, поэтому get_chats их только читает.
+// При первом запуске таблицы заполняются по существующей истории,
+// а вся прежняя история считается прочитанной.
+void SqliteStorage::createChatSummaries(QSqlDatabase db)
+{
+    QSqlQuery query(db);
+    query.exec("SELECT 1 FROM sqlite_master WHERE type = 'table' AND name = 'chat_read_markers'");
+    const bool exists = query.next();
+    query.finish();
+
+    static const char* const tables[] = {
+        "CREATE TABLE IF NOT EXISTS chat_summaries (chat_id INTEGER PRIMARY KEY, last_message_id INTEGER, "
+        "last_sender_id INTEGER, last_message_text TEXT, last_timestamp INTEGER)",
+        "CREATE TABLE IF NOT EXISTS chat_read_markers (chat_id INTEGER, user_id INTEGER, "
+        "last_read_message_id INTEGER DEFAULT 0, unread_count INTEGER DEFAULT 0, PRIMARY KEY (chat_id, user_id))",
+    };
+    static const char* const backfill[] = {
+        "INSERT OR REPLACE INTO chat_summaries (chat_id, last_message_id, last_sender_id, last_message_text, last_timestamp) "
+        "SELECT m.chat_id, m.message_id, m.user_id, m.message_text, CAST(strftime('%s', m.timestamp_sent) AS INTEGER) "
+        "FROM messages m JOIN (SELECT chat_id, MAX(message_id) AS last_id FROM messages GROUP BY chat_id) l "
+        "ON m.message_id = l.last_id",
+        "INSERT OR IGNORE INTO chat_read_markers (chat_id, user_id, last_read_message_id, unread_count) "
+        "SELECT cp.chat_id, cp.user_id, COALESCE(s.last_message_id, 0), 0 FROM chat_participants cp "
+        "LEFT JOIN chat_summaries s ON s.chat_id = cp.chat_id",
+    };
+    db.transaction();
+    for (const char* statement : tables)
+    {
+        if (!query.exec(statement))
+        {
+            qCritical() << "Failed to create chat summary tables:" << query.lastError().text();
+        }
+    }
+    if (!exists)
+    {
+        for (const char* statement : backfill)
+        {
+            if (!query.exec(statement))
+            {
+                qCritical() << "Failed to fill chat summaries:" << query.lastError().text();
+            }
+        }
+    }
+    if (!db.commit())
+    {
+        qCritical() << "Failed to create chat summaries:" << db.lastError().text();
+        db.rollback();
+    }
+}
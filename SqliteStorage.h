@@ -0,0 +1,29 @@
+#ifndef SQLITESTORAGE_H
+#define SQLITESTORAGE_H
+
+#include "SqlStorage.h"
+
+// Хранилище в файле SQLite. Все потоки работают с одним файлом в режиме
+// WAL: читатели не блокируют писателя, а записи (в основном партии
+// MessageWriter) ждут блокировку до QSQLITE_BUSY_TIMEOUT.
+class SqliteStorage : public SqlStorage
+{
+public:
+    explicit SqliteStorage(const QString& path);
+
+    QString description() const override;
+
+protected:
+    QString sql(Statement statement) const override;
+    QString epochSeconds(const QString& column) const override;
+    void configure(QSqlDatabase& db) const override;
+    void connected(QSqlDatabase db) const override;
+    bool createSchema(QSqlDatabase db) override;
+
+private:
+    void createChatSummaries(QSqlDatabase db);
+
+    QString path;
+};
+
+#endif // SQLITESTORAGE_H
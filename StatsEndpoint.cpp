@@ -0,0 +1,60 @@
+#include "StatsEndpoint.h"
+#include "StatsReport.h"
+#include <QDebug>
+
+StatsEndpoint::StatsEndpoint(Server* server, QObject *parent) : QTcpServer(parent), server(server) {
+    connect(this, &QTcpServer::newConnection, this, &StatsEndpoint::onNewConnection);
+}
+
+bool StatsEndpoint::start(quint16 port) {
+    if (!listen(QHostAddress::LocalHost, port)) {
+        qCritical() << "Could not start the metrics endpoint on port" << port << ":" << errorString();
+        return false;
+    }
+    qDebug() << "Metrics endpoint started on http://127.0.0.1:" << port << "/metrics";
+    return true;
+}
+
+void StatsEndpoint::onNewConnection() {
+    while (QTcpSocket* socket = nextPendingConnection()) {
+        connect(socket, &QTcpSocket::disconnected, socket, &QTcpSocket::deleteLater);
+        connect(socket, &QTcpSocket::readyRead, this, [this, socket]() { handleRequest(socket); });
+    }
+}
+
+void StatsEndpoint::handleRequest(QTcpSocket* socket) {
+    // Ждём конца заголовков; тело у GET не бывает
+    if (!socket->canReadLine() || socket->bytesAvailable() > maxRequestSize) {
+        if (socket->bytesAvailable() > maxRequestSize) {
+            socket->abort();
+        }
+        return;
+    }
+    const QByteArray available = socket->peek(socket->bytesAvailable());
+    if (!available.contains("\r\n\r\n") && !available.contains("\n\n")) {
+        return;
+    }
+    const QList<QByteArray> requestLine = socket->readLine().trimmed().split(' ');
+    socket->readAll();
+    socket->disconnect(this); // Один запрос на соединение
+
+    QByteArray status = "200 OK";
+    QByteArray contentType = "text/plain; version=0.0.4; charset=utf-8";
+    QByteArray body;
+    if (requestLine.size() < 2 || requestLine.at(0) != "GET") {
+        status = "405 Method Not Allowed";
+        body = "Only GET is supported\n";
+    } else if (requestLine.at(1) != "/metrics" && !requestLine.at(1).startsWith("/metrics?")) {
+        status = "404 Not Found";
+        body = "See /metrics\n";
+    } else {
+        body = StatsReport(server).prometheus();
+    }
+    QByteArray response = "HTTP/1.0 " + status + "\r\n"
+                          "Content-Type: " + contentType + "\r\n"
+                          "Content-Length: " + QByteArray::number(body.size()) + "\r\n"
+                          "Connection: close\r\n\r\n";
+    response += body;
+    socket->write(response);
+    socket->disconnectFromHost();
+}
@@ -0,0 +1,27 @@
+#ifndef STATSENDPOINT_H
+#define STATSENDPOINT_H
+
+#include <QTcpServer>
+#include <QTcpSocket>
+
+class Server;
+
+// Минимальный HTTP-сервер для сбора метрик Prometheus: на GET /metrics
+// отдаёт StatsReport в текстовом формате и закрывает соединение.
+// Слушает отдельный порт только на localhost и работает в главном потоке.
+class StatsEndpoint : public QTcpServer {
+    Q_OBJECT
+
+public:
+    explicit StatsEndpoint(Server* server, QObject *parent = nullptr);
+    bool start(quint16 port);
+
+private:
+    void onNewConnection();
+    void handleRequest(QTcpSocket* socket);
+
+    Server* server;
+    static const int maxRequestSize = 8 * 1024;
+};
+
+#endif // STATSENDPOINT_H
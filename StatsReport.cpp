@@ -0,0 +1,141 @@
+#include "StatsReport.h"
+#include "Server.h"
+#include "Logger.h"
+#include "EventBus.h"
+
+StatsReport::StatsReport(Server* server) : snapshot(Metrics::getInstance()->snapshot())
+{
+    value("messenger_connections", "Open client connections.", "gauge", server->connectionCount());
+    value("messenger_connections_accepted_total", "Accepted client connections.", "counter",
+          snapshot.connectionsAccepted);
+    value("messenger_connections_rejected_total", "Connections closed at once because of the connection limit.",
+          "counter", server->rejectedConnections());
+    value("messenger_connections_idle_closed_total", "Connections closed after the idle timeout.", "counter",
+          server->idleDisconnects());
+    value("messenger_online_users", "Logged in users with at least one connection.", "gauge",
+          server->userRegistry().onlineUsers());
+    value("messenger_sent_bytes_total", "Bytes written to client sockets, including events.", "counter",
+          snapshot.bytesOut);
+    value("messenger_unknown_commands_total", "Lines with an unknown command name.", "counter",
+          snapshot.unknownCommands);
+
+    if (EventBus* bus = server->eventBus())
+    {
+        value("messenger_bus_instances", "Other server processes known to the event bus.", "gauge",
+              bus->instanceCount());
+    }
+
+    DbExecutor* executor = server->dbExecutor();
+    value("messenger_db_queue_depth", "Queued database requests.", "gauge", executor->queueDepth());
+    value("messenger_db_queue_capacity", "Maximum number of queued database requests.", "gauge",
+          executor->queueCapacity());
+    value("messenger_db_rejected_total", "Requests rejected because the database queue was full.", "counter",
+          executor->rejectedCount());
+    PasswordHasher* hasher = server->passwordHasher();
+    value("messenger_password_hash_in_flight", "Register/login requests holding a password hashing slot.", "gauge",
+          hasher->inFlight());
+    value("messenger_password_hash_rejected_total", "Register/login requests rejected by hashing limits.", "counter",
+          hasher->rejectedCount());
+    MessageWriter* writer = server->messageWriter();
+    value("messenger_message_writer_queue_depth", "Messages waiting for a write batch.", "gauge", writer->queueDepth());
+    value("messenger_message_batches_total", "Committed message write transactions.", "counter",
+          writer->committedBatches());
+    value("messenger_messages_committed_total", "Messages committed by the message writer.", "counter",
+          writer->committedMessages());
+
+    IdentityCache* identities = server->identityCache();
+    value("messenger_identity_cache_hits_total", "Login/user_id lookups answered from memory.", "counter",
+          identities->hits());
+    value("messenger_identity_cache_misses_total", "Login/user_id lookups that went to the database.", "counter",
+          identities->misses());
+    // При --reuse-port кэша сообщений нет
+    if (RecentMessageCache* recent = server->recentMessageCache())
+    {
+        value("messenger_message_cache_hits_total", "get_messages pages answered from memory.", "counter",
+              recent->hits());
+        value("messenger_message_cache_misses_total", "get_messages pages that needed SQL.", "counter",
+              recent->misses());
+        value("messenger_message_cache_bytes", "Estimated memory used by cached messages.", "gauge",
+              recent->memoryUsed());
+        value("messenger_message_cache_chats", "Chats in the recent message cache.", "gauge", recent->chatCount());
+    }
+    value("messenger_log_dropped_total", "Log records dropped because the log queue was full.", "counter",
+          Logger::getInstance()->droppedCount());
+
+    Family commands = family("messenger_commands_total", "Handled commands.", "counter");
+    Family errors = family("messenger_command_errors_total", "Commands answered with fail.", "counter");
+    Family bytesIn = family("messenger_command_received_bytes_total", "Command bytes received.", "counter");
+    Family bytesOut = family("messenger_command_reply_bytes_total", "Reply bytes produced by commands.", "counter");
+    for (int i = 0; i < int(Protocol::Command::Count); ++i)
+    {
+        const Metrics::CommandSnapshot& command = snapshot.commands[i];
+        const QByteArray labels = QByteArray("{command=\"")
+            + Protocol::commandSpec(static_cast<Protocol::Command>(i))->name + "\"}";
+        commands.samples.append(Sample{QByteArray(), labels, double(command.count)});
+        errors.samples.append(Sample{QByteArray(), labels, double(command.errors)});
+        bytesIn.samples.append(Sample{QByteArray(), labels, double(command.bytesIn)});
+        bytesOut.samples.append(Sample{QByteArray(), labels, double(command.bytesOut)});
+    }
+    list << commands << errors << bytesIn << bytesOut;
+
+    Family latency = family("messenger_command_duration_seconds",
+                            "Time from parsing a command to its last reply.", "summary");
+    for (int i = 0; i < int(Protocol::Command::Count); ++i)
+    {
+        const char* name = Protocol::commandSpec(static_cast<Protocol::Command>(i))->name;
+        summary(latency, QByteArray("command=\"") + name + "\"", snapshot.commands[i].latency);
+    }
+    list << latency;
+
+    Family sql = family("messenger_sql_duration_seconds", "SQL time per query site.", "summary");
+    for (int i = 0; i < Metrics::SqlSiteCount; ++i)
+    {
+        const char* name = Metrics::sqlSiteName(static_cast<Metrics::SqlSite>(i));
+        summary(sql, QByteArray("site=\"") + name + "\"", snapshot.sql[i]);
+    }
+    list << sql;
+}
+
+StatsReport::Family StatsReport::family(const char* name, const char* help, const char* type)
+{
+    Family result;
+    result.name = name;
+    result.help = help;
+    result.type = type;
+    return result;
+}
+
+void StatsReport::value(const char* name, const char* help, const char* type, double value)
+{
+    Family single = family(name, help, type);
+    single.samples.append(Sample{QByteArray(), QByteArray(), value});
+    list.append(single);
+}
+
+void StatsReport::summary(Family& family, const QByteArray& labels, const Metrics::HistogramSnapshot& histogram)
+{
+    static const char* const quantiles[] = { "0.5", "0.9", "0.99", "0.999" };
+    for (const char* quantile : quantiles)
+    {
+        family.samples.append(Sample{QByteArray(), "{" + labels + ",quantile=\"" + quantile + "\"}",
+                                     histogram.percentile(QByteArray(quantile).toDouble()) / 1e6});
+    }
+    family.samples.append(Sample{"_sum", "{" + labels + "}", histogram.sumMicros / 1e6});
+    family.samples.append(Sample{"_count", "{" + labels + "}", double(histogram.count)});
+}
+
+QByteArray StatsReport::prometheus() const
+{
+    QByteArray out;
+    out.reserve(32 * 1024);
+    for (const Family& family : list)
+    {
+        out += "# HELP " + family.name + ' ' + family.help + '\n';
+        out += "# TYPE " + family.name + ' ' + family.type + '\n';
+        for (const Sample& sample : family.samples)
+        {
+            out += family.name + sample.suffix + sample.labels + ' ' + QByteArray::number(sample.value, 'g', 15) + '\n';
+        }
+    }
+    return out;
+}
@@ -0,0 +1,47 @@
+#ifndef STATSREPORT_H
+#define STATSREPORT_H
+
+#include <QByteArray>
+#include <QVector>
+#include "Metrics.h"
+
+class Server;
+
+// Снимок всех показателей сервера: счётчики и гистограммы Metrics плюс
+// текущие значения (подключения, очереди, кэши). Один и тот же снимок
+// отдаётся командой stats и в текстовом формате Prometheus.
+class StatsReport
+{
+public:
+    struct Sample
+    {
+        QByteArray suffix; // "_sum", "_count" у summary, иначе пусто
+        QByteArray labels; // {command="login"} или пусто
+        double value = 0;
+    };
+
+    struct Family
+    {
+        QByteArray name;
+        QByteArray help;
+        QByteArray type; // counter, gauge или summary
+        QVector<Sample> samples;
+    };
+
+    explicit StatsReport(Server* server);
+
+    const QVector<Family>& families() const { return list; }
+    const Metrics::Snapshot& metrics() const { return snapshot; }
+    // Текстовый формат экспозиции Prometheus 0.0.4.
+    QByteArray prometheus() const;
+
+private:
+    static Family family(const char* name, const char* help, const char* type);
+    void value(const char* name, const char* help, const char* type, double value);
+    void summary(Family& family, const QByteArray& labels, const Metrics::HistogramSnapshot& histogram);
+
+    Metrics::Snapshot snapshot;
+    QVector<Family> list;
+};
+
+#endif // STATSREPORT_H
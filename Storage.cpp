@@ -0,0 +1,39 @@
+#include "Storage.h"
+#include "SqliteStorage.h"
+#include "PostgresStorage.h"
+#include "MemoryStorage.h"
+
+bool StorageConfig::parseKind(const QString& name, Kind* kind)
+{
+    if (name == "sqlite")
+    {
+        *kind = Sqlite;
+    }
+    else if (name == "postgres")
+    {
+        *kind = Postgres;
+    }
+    else if (name == "memory")
+    {
+        *kind = Memory;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+Storage* Storage::create(const StorageConfig& config)
+{
+    switch (config.kind)
+    {
+    case StorageConfig::Sqlite:
+        return new SqliteStorage(config.sqlitePath);
+    case StorageConfig::Postgres:
+        return new PostgresStorage(config);
+    case StorageConfig::Memory:
+        return new MemoryStorage();
+    }
+    return nullptr;
+}
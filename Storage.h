@@ -0,0 +1,87 @@
+#ifndef STORAGE_H
+#define STORAGE_H
+
+#include <QDateTime>
+#include <QString>
+#include <QVector>
+#include <functional>
+#include "Models.h"
+
+// Параметры хранилища (опции --storage, --db и --pg-* в main.cpp).
+struct StorageConfig
+{
+    enum Kind
+    {
+        Sqlite,
+        Postgres,
+        Memory
+    };
+
+    Kind kind = Sqlite;
+    QString sqlitePath;
+    QString pgHost = "localhost";
+    int pgPort = 5432;
+    QString pgDatabase = "messenger";
+    QString pgUser;     // Пароль libpq берёт из PGPASSWORD или ~/.pgpass
+    int pgPoolSize = 0; // 0 - по числу потоков, которым нужна база
+
+    // "sqlite", "postgres" или "memory"; false - неизвестное имя.
+    static bool parseKind(const QString& name, Kind* kind);
+};
+
+// Хранилище пользователей, чатов, участников и сообщений. Server и
+// MessageWriter работают только через этот интерфейс, реализация
+// выбирается при запуске:
+//   SqliteStorage   - файл SQLite, как раньше;
+//   PostgresStorage - PostgreSQL (QPSQL) с фиксированным пулом соединений
+//                     и подготовленными запросами;
+//   MemoryStorage   - всё в памяти процесса, для нагрузочных прогонов без базы.
+// Методы вызываются из потоков DbExecutor и MessageWriter (и из потока
+// Server при запуске); реализации потокобезопасны. Ошибки пишутся в лог,
+// методы возвращают -1/false/пустой результат.
+class Storage
+{
+public:
+    typedef std::function<void(const QString& login, int userId)> UserVisitor;
+
+    static Storage* create(const StorageConfig& config);
+    virtual ~Storage() {}
+
+    // Создаёт схему и проверяет подключение; false - работать нельзя.
+    virtual bool open() = 0;
+    // Поток начинает работать с хранилищем (потоки DbExecutor и MessageWriter).
+    virtual void attachThread() {}
+    // Освобождает ресурсы текущего потока; вызывать перед его завершением.
+    virtual void releaseThread() {}
+    virtual QString description() const = 0; // Для лога
+
+    // user_id или -1, если логина нет; ok = false - ошибка запроса.
+    virtual int findUser(const QString& login, bool* ok) = 0;
+    // user_id нового пользователя; -1 - ошибка (в том числе логин занят).
+    virtual int addUser(const QString& login, const QString& passwordHash) = 0;
+    virtual int findCredentials(const QString& login, QString* storedPassword) = 0;
+    virtual bool updatePasswordHash(int userId, const QString& passwordHash) = 0;
+    // Пользователи по возрастанию user_id, не больше limit (-1 - все).
+    virtual int forEachUser(int limit, const UserVisitor& visit) = 0;
+
+    virtual int createChat(const QString& chatName, const QString& chatType) = 0;
+    // Добавляет участника вместе с его отметкой о прочтении.
+    virtual bool addParticipant(int chatId, int userId) = 0;
+    virtual bool chatExistsBetween(int userId1, int userId2) = 0;
+    virtual QVector<int> chatParticipants(int chatId) = 0;
+    // По убыванию последнего message_id, затем chat_id.
+    virtual QList<ChatListItem> chatsForUser(int userId) = 0;
+    // Отметка только двигается вперёд; false - пользователь не в чате или ошибка.
+    virtual bool markRead(int chatId, int userId, int messageId) = 0;
+
+    virtual MessagePage loadMessagePage(const MessageCursor& cursor, bool* ok) = 0;
+    // Записывает партию одной транзакцией вместе со сводками чатов и
+    // счётчиками непрочитанных. В results[i] - message_id или ошибка
+    // для batch[i]; возвращается только после того, как партия сохранена.
+    // Ошибка одного сообщения не мешает сохранить остальные; если партию
+    // не удалось зафиксировать, ошибка стоит у всех сообщений.
+    virtual void appendMessages(const QVector<NewMessage>& batch, const QDateTime& sentAt,
+                                QVector<StoredMessage>* results) = 0;
+};
+
+#endif // STORAGE_H
@@ -0,0 +1,63 @@
+#include "UserRegistry.h"
+#include "ClientConnection.h"
+
+void UserRegistry::add(int userId, ClientConnection* connection)
+{
+    QWriteLocker locker(&lock);
+    if (!connections.contains(userId, connection))
+    {
+        const bool first = !connections.contains(userId);
+        connections.insert(userId, connection);
+        if (first && presenceChanged)
+        {
+            presenceChanged(userId, true);
+        }
+    }
+}
+
+void UserRegistry::remove(int userId, ClientConnection* connection)
+{
+    QWriteLocker locker(&lock);
+    if (connections.remove(userId, connection) > 0 && !connections.contains(userId) && presenceChanged)
+    {
+        presenceChanged(userId, false);
+    }
+}
+
+bool UserRegistry::isOnline(int userId) const
+{
+    QReadLocker locker(&lock);
+    return connections.contains(userId);
+}
+
+int UserRegistry::onlineUsers() const
+{
+    QReadLocker locker(&lock);
+    return connections.uniqueKeys().size();
+}
+
+int UserRegistry::post(const QVector<int>& userIds, const QByteArray& textEvent, const QByteArray& binaryEvent,
+                       const ClientConnection* except) const
+{
+    // Пока держим read-lock, подключение не может удалить себя из реестра,
+    // а отложенный вызов Qt сам отбросит, если объект будет удалён до доставки.
+    QReadLocker locker(&lock);
+    int delivered = 0;
+    for (int userId : userIds)
+    {
+        auto it = connections.constFind(userId);
+        while (it != connections.constEnd() && it.key() == userId)
+        {
+            ClientConnection* connection = it.value();
+            if (connection != except)
+            {
+                QMetaObject::invokeMethod(connection, [connection, textEvent, binaryEvent]() {
+                    connection->sendEvent(textEvent, binaryEvent);
+                }, Qt::QueuedConnection);
+                ++delivered;
+            }
+            ++it;
+        }
+    }
+    return delivered;
+}
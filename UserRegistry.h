@@ -0,0 +1,41 @@
+#ifndef USERREGISTRY_H
+#define USERREGISTRY_H
+
+#include <QMultiHash>
+#include <QReadWriteLock>
+#include <QByteArray>
+#include <QVector>
+#include <functional>
+
+class ClientConnection;
+
+// Потокобезопасное соответствие user_id -> подключения пользователя.
+// Подключения живут в разных потоках-реакторах, поэтому писать в них
+// напрямую нельзя: post() ставит отправку в очередь потока подключения.
+// Событие кодируется один раз для каждого протокола, и один и тот же буфер
+// (QByteArray с общим счётчиком ссылок) уходит во все подключения.
+class UserRegistry
+{
+public:
+    // Вызывается под блокировкой при первом подключении пользователя и после
+    // разрыва последнего. Задаётся до приёма подключений.
+    typedef std::function<void(int userId, bool online)> PresenceHandler;
+    void setPresenceHandler(PresenceHandler handler) { presenceChanged = handler; }
+
+    void add(int userId, ClientConnection* connection);
+    void remove(int userId, ClientConnection* connection);
+    bool isOnline(int userId) const;
+    int onlineUsers() const;
+    // Отправляет событие всем подключениям пользователей userIds, кроме except.
+    // Подключение само выбирает textEvent или binaryEvent по своему протоколу.
+    // Возвращает число подключений, которым событие поставлено в очередь.
+    int post(const QVector<int>& userIds, const QByteArray& textEvent, const QByteArray& binaryEvent,
+             const ClientConnection* except = nullptr) const;
+
+private:
+    PresenceHandler presenceChanged;
+    mutable QReadWriteLock lock;
+    QMultiHash<int, ClientConnection*> connections;
+};
+
+#endif // USERREGISTRY_H
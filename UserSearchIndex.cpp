@@ -0,0 +1,112 @@
+#include "UserSearchIndex.h"
+#include "Storage.h"
+
+int UserSearchIndex::load(Storage* storage)
+{
+    QWriteLocker locker(&lock);
+    storage->forEachUser(-1, [this](const QString& login, int) { addLocked(login); });
+    return logins.size();
+}
+
+void UserSearchIndex::add(const QString& login)
+{
+    QWriteLocker locker(&lock);
+    addLocked(login);
+}
+
+int UserSearchIndex::size() const
+{
+    QReadLocker locker(&lock);
+    return logins.size();
+}
+
+quint64 UserSearchIndex::gramKey(const QString& lowered, int position, int length)
+{
+    // Длина в старших битах, чтобы "a" и "\0a" не совпали
+    quint64 key = quint64(length) << 48;
+    for (int i = 0; i < length; ++i)
+    {
+        key |= quint64(lowered.at(position + i).unicode()) << (16 * (length - 1 - i));
+    }
+    return key;
+}
+
+void UserSearchIndex::addLocked(const QString& login)
+{
+    const int index = logins.size();
+    const QString lowered = login.toLower();
+    logins.append(login);
+    loweredLogins.append(lowered);
+    for (int length = 1; length <= 3; ++length)
+    {
+        for (int i = 0; i + length <= lowered.size(); ++i)
+        {
+            QVector<int>& list = postings[gramKey(lowered, i, length)];
+            // Одна подстрока может встретиться в логине несколько раз
+            if (list.isEmpty() || list.last() != index)
+            {
+                list.append(index);
+            }
+        }
+    }
+}
+
+QStringList UserSearchIndex::search(const QString& text, int offset, int limit) const
+{
+    QStringList results;
+    if (limit <= 0)
+    {
+        return results;
+    }
+    const QString needle = text.toLower();
+    int skipped = 0;
+    auto consider = [&](int index) {
+        if (!loweredLogins.at(index).contains(needle))
+        {
+            return true;
+        }
+        if (skipped < offset)
+        {
+            ++skipped;
+            return true;
+        }
+        results.append(logins.at(index));
+        return results.size() < limit;
+    };
+
+    QReadLocker locker(&lock);
+    if (needle.isEmpty())
+    {
+        // Подходит любой логин: проход заканчивается на offset + limit
+        for (int i = 0; i < logins.size() && consider(i); ++i)
+        {
+        }
+        return results;
+    }
+
+    // Все совпадения содержат каждую подстроку запроса, поэтому достаточно
+    // проверить самый короткий список. Запрос короче трёх символов - это
+    // одна подстрока, и её список уже состоит только из совпадений
+    const int length = qMin(3, needle.size());
+    const QVector<int>* shortest = nullptr;
+    for (int i = 0; i + length <= needle.size(); ++i)
+    {
+        auto it = postings.constFind(gramKey(needle, i, length));
+        if (it == postings.constEnd())
+        {
+            return results;
+        }
+        if (shortest == nullptr || it.value().size() < shortest->size())
+        {
+            shortest = &it.value();
+        }
+    }
+    for (int index : *shortest)
+    {
+        if (!consider(index))
+        {
+            break;
+        }
+    }
+    return results;
+}
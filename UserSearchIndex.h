@@ -0,0 +1,38 @@
+#ifndef USERSEARCHINDEX_H
+#define USERSEARCHINDEX_H
+
+#include <QHash>
+#include <QReadWriteLock>
+#include <QStringList>
+#include <QVector>
+
+class Storage;
+
+// Индекс логинов для команды search: поиск подстроки без учёта регистра
+// (как LIKE '%text%' в SQLite), но без полного прохода по user_auth.
+// Для запросов от трёх символов кандидаты берутся из самого короткого
+// списка триграмм запроса и проверяются на вхождение. Для запросов из
+// одного-двух символов есть свои списки по всем символам и парам символов
+// логинов, так что и они не проходят по логинам без совпадений.
+class UserSearchIndex
+{
+public:
+    // Загружает все логины из хранилища.
+    int load(Storage* storage);
+    void add(const QString& login);
+    // Результаты в порядке регистрации; offset и limit - как в SQL.
+    QStringList search(const QString& text, int offset, int limit) const;
+    int size() const;
+
+private:
+    // Ключ подстроки lowered длиной length (1..3) с позиции position.
+    static quint64 gramKey(const QString& lowered, int position, int length);
+    void addLocked(const QString& login);
+
+    mutable QReadWriteLock lock;
+    QStringList logins;        // Исходное написание
+    QStringList loweredLogins; // Для сравнения без учёта регистра
+    QHash<quint64, QVector<int>> postings; // Подстрока 1-3 символов -> индексы в logins по возрастанию
+};
+
+#endif // USERSEARCHINDEX_H
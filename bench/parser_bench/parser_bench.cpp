@@ -0,0 +1,244 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QStringList>
+#include <QRandomGenerator>
+#include <QDebug>
+#include <cstdio>
+#include "Protocol.h"
+
+// Набор типичных команд клиента.
+static QByteArray buildWorkload(int lines)
+{
+    static const char* templates[] = {
+        "send_message:17:42:hello there, how are you doing today?\n",
+        "get_messages:17\n",
+        "login:alice:secret\n",
+        "search:ali\n",
+        "get_chats:alice\n",
+        "get_user_id:bob\n",
+        "create_chat:dialog:private:alice:bob\n",
+        "register:carol:password\n",
+    };
+    const int templateCount = int(sizeof(templates) / sizeof(templates[0]));
+    QByteArray data;
+    for (int i = 0; i < lines; ++i)
+    {
+        data += templates[i % templateCount];
+    }
+    return data;
+}
+
+// Разбор в том виде, в каком он был в readyRead до появления LineFramer.
+// Проверки parts.count() - как в исходном коде: команда без нужного числа
+// полей обрывала разбор всего прочитанного куска (return из readyRead).
+// Исключение - create_chat: в исходном коде проверки не было, и обрывок
+// вроде "create_chat:dialog" приводил к чтению за пределами списка. Здесь
+// она добавлена, иначе бенчмарк падал бы на нарезанных сегментах.
+static int parseLegacy(const QByteArray& data)
+{
+    int handled = 0;
+    QString message = QString::fromUtf8(data).trimmed();
+    QStringList lines = message.split("\n", QString::SkipEmptyParts);
+    for (const QString& line : lines)
+    {
+        QStringList parts = line.split(":");
+        if (parts.isEmpty()) return handled;
+        QString command = parts.first();
+        if (command == "register" || command == "login") {
+            if (parts.count() < 3) return handled;
+            handled += parts.at(1).size() + parts.at(2).size() > 0;
+        } else if (command == "search") {
+            if (parts.count() < 2) return handled;
+            handled += parts.at(1).size() >= 0;
+        } else if (command == "create_chat") {
+            if (parts.count() < 5) return handled; // В исходном коде проверки нет
+            handled += parts.at(4).size() >= 0;
+        } else if (command == "get_chats") {
+            if (parts.count() < 2) return handled;
+            handled += parts.at(1).size() >= 0;
+        } else if (command == "send_message") {
+            if (parts.count() < 4) return handled;
+            handled += parts.at(1).toInt() + parts.at(2).toInt() + parts.at(3).size() > 0;
+        } else if (command == "get_messages") {
+            if (parts.count() < 2) return handled;
+            handled += parts.at(1).toInt() > 0;
+        } else if (command == "get_user_id") {
+            if (parts.count() < 2) return handled;
+            handled += parts.at(1).size() >= 0;
+        }
+    }
+    return handled;
+}
+
+// Новый разбор: те же преобразования полей, что делают обработчики.
+static int parseStreaming(Protocol::LineFramer& framer, const QByteArray& data)
+{
+    int handled = 0;
+    framer.append(data);
+    const char* line;
+    int size;
+    Protocol::FieldView fields[Protocol::MaxFields];
+    while (framer.nextLine(&line, &size))
+    {
+        int nameSize = 0;
+        while (nameSize < size && line[nameSize] != ':')
+        {
+            ++nameSize;
+        }
+        const Protocol::CommandSpec* spec = Protocol::findCommand(line, nameSize);
+        if (spec == nullptr)
+        {
+            continue;
+        }
+        int count = Protocol::splitFields(line, size, fields, spec->maxFields);
+        if (count < spec->minFields)
+        {
+            continue;
+        }
+        switch (spec->command)
+        {
+        case Protocol::Command::SendMessage:
+            handled += fields[1].toInt() + fields[2].toInt() + fields[3].toString().size() > 0;
+            break;
+        case Protocol::Command::GetMessages:
+            handled += fields[1].toInt() > 0;
+            break;
+        default:
+            handled += fields[count - 1].toString().size() >= 0;
+            break;
+        }
+    }
+    return handled;
+}
+
+static void runBenchmark(int lines, int segmentSize, int rounds)
+{
+    const QByteArray workload = buildWorkload(lines);
+    QList<QByteArray> segments;
+    for (int offset = 0; offset < workload.size(); offset += segmentSize)
+    {
+        segments.append(workload.mid(offset, segmentSize));
+    }
+
+    QElapsedTimer timer;
+    qint64 handled = 0;
+    timer.start();
+    for (int r = 0; r < rounds; ++r)
+    {
+        // Старый код видел каждый сегмент как отдельный набор строк
+        for (const QByteArray& segment : segments)
+        {
+            handled += parseLegacy(segment);
+        }
+    }
+    double legacySeconds = timer.nsecsElapsed() / 1e9;
+    qint64 legacyHandled = handled;
+
+    handled = 0;
+    timer.restart();
+    for (int r = 0; r < rounds; ++r)
+    {
+        Protocol::LineFramer framer;
+        for (const QByteArray& segment : segments)
+        {
+            handled += parseStreaming(framer, segment);
+        }
+    }
+    double streamingSeconds = timer.nsecsElapsed() / 1e9;
+
+    const double total = double(lines) * rounds;
+    std::printf("segment_bytes=%d lines=%d rounds=%d\n", segmentSize, lines, rounds);
+    std::printf("legacy:    %.0f commands/s (%lld parsed, split commands are lost)\n",
+                total / legacySeconds, static_cast<long long>(legacyHandled));
+    std::printf("streaming: %.0f commands/s (%lld parsed)\n",
+                total / streamingSeconds, static_cast<long long>(handled));
+}
+
+// Проверяет, что при любой нарезке на сегменты и при мусоре на входе
+// LineFramer выдаёт те же строки и не выходит за границы буфера.
+static bool runFuzz(int iterations)
+{
+    QRandomGenerator random(12345);
+    for (int i = 0; i < iterations; ++i)
+    {
+        QByteArray input;
+        const int length = random.bounded(1, 512);
+        for (int j = 0; j < length; ++j)
+        {
+            // Чаще всего печатные символы, иногда разделители и мусор
+            int kind = random.bounded(10);
+            if (kind == 0) input += '\n';
+            else if (kind == 1) input += ':';
+            else if (kind == 2) input += '\\';
+            else if (kind == 3) input += char(random.bounded(256));
+            else input += char(random.bounded('a', 'z' + 1));
+        }
+
+        QList<QByteArray> parts = input.split('\n');
+        parts.removeLast(); // Хвост после последнего '\n' остаётся в буфере
+        QList<QByteArray> expected;
+        for (QByteArray line : parts)
+        {
+            if (line.endsWith('\r')) line.chop(1);
+            if (!line.isEmpty()) expected.append(line);
+        }
+
+        Protocol::LineFramer framer;
+        QList<QByteArray> actual;
+        int offset = 0;
+        while (offset < input.size())
+        {
+            int chunk = random.bounded(1, 64);
+            framer.append(input.mid(offset, chunk));
+            offset += chunk;
+            const char* line;
+            int size;
+            while (framer.nextLine(&line, &size))
+            {
+                actual.append(QByteArray(line, size));
+                Protocol::FieldView fields[Protocol::MaxFields];
+                int count = Protocol::splitFields(line, size, fields, random.bounded(1, Protocol::MaxFields + 1));
+                for (int f = 0; f < count; ++f)
+                {
+                    fields[f].toString();
+                    fields[f].toInt();
+                }
+            }
+        }
+        if (actual != expected)
+        {
+            std::printf("fuzz mismatch on iteration %d\n", i);
+            return false;
+        }
+    }
+    std::printf("fuzz: %d iterations ok\n", iterations);
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption linesOption("lines", "Commands per round.", "count", "100000");
+    QCommandLineOption roundsOption("rounds", "Benchmark rounds.", "count", "5");
+    QCommandLineOption fuzzOption("fuzz", "Fuzz iterations (0 to skip).", "count", "20000");
+    parser.addOption(linesOption);
+    parser.addOption(roundsOption);
+    parser.addOption(fuzzOption);
+    parser.process(app);
+
+    const int lines = parser.value(linesOption).toInt();
+    const int rounds = parser.value(roundsOption).toInt();
+    // Целые пакеты и мелкие TCP-сегменты
+    runBenchmark(lines, 64 * 1024, rounds);
+    runBenchmark(lines, 37, rounds);
+
+    const int fuzzIterations = parser.value(fuzzOption).toInt();
+    if (fuzzIterations > 0 && !runFuzz(fuzzIterations))
+    {
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,16 @@
+QT -= gui
+QT += core
+CONFIG += c++14 console
+CONFIG -= app_bundle
+
+# Микробенчмарк и фаззер разбора текстового протокола (Protocol.cpp).
+# Сравнивает старый разбор через QString::split с потоковым LineFramer.
+
+INCLUDEPATH += ../..
+
+SOURCES += \
+        parser_bench.cpp \
+        ../../Protocol.cpp
+
+HEADERS += \
+    ../../Protocol.h
@@ -0,0 +1,153 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QTemporaryDir>
+#include <QDebug>
+#include <cstdio>
+#include <memory>
+#include "MessageWriter.h"
+#include "SqliteStorage.h"
+
+// Прежнее поведение: журнал по умолчанию, каждое сообщение - отдельная транзакция.
+static double runAutocommit(const QString& path, int count)
+{
+    {
+        // Схему создаёт то же хранилище, что и у сервера
+        SqliteStorage storage(path);
+        if (!storage.open())
+        {
+            return 0;
+        }
+        storage.releaseThread();
+    }
+    double rate = 0;
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", "autocommit");
+        db.setDatabaseName(path);
+        if (!db.open())
+        {
+            qCritical() << "Could not open database:" << db.lastError().text();
+            return 0;
+        }
+        QSqlQuery query(db);
+        // SqliteStorage включает WAL, а он сохраняется в файле базы
+        if (!query.exec("PRAGMA journal_mode=DELETE"))
+        {
+            qCritical() << "Could not switch journal mode:" << query.lastError().text();
+            return 0;
+        }
+        query.prepare("INSERT INTO messages (chat_id, user_id, message_text) VALUES (:chatId, :userId, :messageText)");
+        QElapsedTimer timer;
+        timer.start();
+        for (int i = 0; i < count; ++i)
+        {
+            query.bindValue(":chatId", i % 100);
+            query.bindValue(":userId", i % 1000);
+            query.bindValue(":messageText", QString("message %1").arg(i));
+            if (!query.exec())
+            {
+                qCritical() << "Insert failed:" << query.lastError().text();
+                return 0;
+            }
+        }
+        rate = count * 1000.0 / qMax<qint64>(1, timer.elapsed());
+        db.close();
+    }
+    QSqlDatabase::removeDatabase("autocommit");
+    return rate;
+}
+
+// Групповая запись: clients "клиентов", у каждого одно сообщение в полёте,
+// как у ClientConnection; следующее уходит после подтверждения предыдущего.
+static double runBatched(const QString& path, int count, int clients, int batchSize, int batchDelayMs,
+                         quint64* batches)
+{
+    SqliteStorage storage(path);
+    if (!storage.open())
+    {
+        return 0;
+    }
+
+    QObject receiver;
+    std::shared_ptr<ResultGuard> guard = std::make_shared<ResultGuard>(&receiver);
+    MessageWriter writer(&storage, batchSize, batchDelayMs, clients, MessageWriter::ParticipantsLookup());
+
+    QEventLoop loop;
+    int submitted = 0;
+    int completed = 0;
+    bool failed = false;
+    std::function<void()> submitNext;
+    MessageWriter::Done done = [&](const StoredMessage& stored) {
+        if (!stored.error.isEmpty())
+        {
+            qCritical() << "Insert failed:" << stored.error;
+            failed = true;
+        }
+        if (++completed == count || failed)
+        {
+            loop.quit();
+            return;
+        }
+        submitNext();
+    };
+    submitNext = [&]() {
+        if (submitted < count)
+        {
+            const int i = submitted++;
+            writer.submit(guard, i % 100, i % 1000, QString("message %1").arg(i), done);
+        }
+    };
+
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < clients; ++i)
+    {
+        submitNext();
+    }
+    loop.exec();
+    const qint64 elapsed = timer.elapsed();
+    guard->invalidate();
+    *batches = writer.committedBatches();
+    return failed ? 0 : count * 1000.0 / qMax<qint64>(1, elapsed);
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCommandLineParser parser;
+    parser.setApplicationDescription("send_message write benchmark");
+    parser.addHelpOption();
+    QCommandLineOption messagesOption("messages", "Number of messages to insert.", "count", "5000");
+    QCommandLineOption clientsOption("clients", "Concurrent senders for the batched run.", "count", "256");
+    QCommandLineOption batchSizeOption("batch-size", "Maximum messages per transaction.", "count", "256");
+    QCommandLineOption batchDelayOption("batch-delay-ms", "Maximum wait for a batch to fill up.", "ms", "2");
+    parser.addOption(messagesOption);
+    parser.addOption(clientsOption);
+    parser.addOption(batchSizeOption);
+    parser.addOption(batchDelayOption);
+    parser.process(app);
+
+    const int messages = parser.value(messagesOption).toInt();
+    QTemporaryDir dir;
+    if (!dir.isValid())
+    {
+        qCritical() << "Could not create a temporary directory";
+        return 1;
+    }
+
+    const double autocommit = runAutocommit(dir.filePath("autocommit.db"), messages);
+    quint64 batches = 0;
+    const double batched = runBatched(dir.filePath("batched.db"), messages,
+                                      parser.value(clientsOption).toInt(),
+                                      parser.value(batchSizeOption).toInt(),
+                                      parser.value(batchDelayOption).toInt(), &batches);
+
+    std::printf("messages=%d\n", messages);
+    std::printf("autocommit: %.0f messages/s\n", autocommit);
+    std::printf("batched:    %.0f messages/s (%llu transactions)\n", batched, (unsigned long long)batches);
+    return autocommit > 0 && batched > 0 ? 0 : 1;
+}
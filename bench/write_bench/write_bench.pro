@@ -0,0 +1,24 @@
+QT -= gui
+QT += core sql
+CONFIG += c++14 console
+CONFIG -= app_bundle
+
+# Бенчмарк записи send_message: по транзакции на сообщение (как было)
+# против групповой записи MessageWriter в WAL.
+
+INCLUDEPATH += ../..
+
+SOURCES += \
+        write_bench.cpp \
+        ../../MessageWriter.cpp \
+        ../../Metrics.cpp \
+        ../../SqliteStorage.cpp \
+        ../../SqlStorage.cpp
+
+HEADERS += \
+    ../../DbExecutor.h \
+    ../../MessageWriter.h \
+    ../../Metrics.h \
+    ../../SqliteStorage.h \
+    ../../SqlStorage.h \
+    ../../Storage.h
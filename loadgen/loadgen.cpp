@@ -0,0 +1,776 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QThread>
+#include <QQueue>
+#include <QRandomGenerator>
+#include <QJsonObject>
+#include <QJsonDocument>
+#include <QFile>
+#include <QDateTime>
+#include <QDebug>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <vector>
+#include "Protocol.h"
+
+// Генератор нагрузки для сервера мессенджера. Каждый клиент - отдельное
+// TCP-подключение с текстовым протоколом. Прогон идёт в три этапа:
+//   1. подготовка: register, login и get_user_id для каждого клиента;
+//   2. клиенты попарно создают чаты (чётный с соседним нечётным);
+//   3. замер: операции по заданной смеси с заданной общей частотой.
+// Задержка операции считается от момента, когда её полагалось отправить
+// по расписанию, а не от фактической отправки, поэтому отставание
+// клиента или сервера не прячется (coordinated omission).
+
+namespace
+{
+
+enum Op
+{
+    OpRegister,
+    OpLogin,
+    OpCreateChat,
+    OpSendMessage,
+    OpGetMessages,
+    OpSearch,
+    OpGetChats,
+    MeasuredOps,            // Операции выше участвуют в смеси
+    OpGetUserId = MeasuredOps,
+    OpCount
+};
+
+const char* const opNames[OpCount] = {
+    "register", "login", "create_chat", "send_message", "get_messages", "search", "get_chats", "get_user_id",
+};
+
+// Строка ответа, завершающая операцию (строки *_item перед ней пропускаются).
+const char* const opTerminators[OpCount] = {
+    "register", "login", "create_chat", "send_message", "end_of_messages", "search_end", "end_of_chats", "user_id",
+};
+
+struct Options
+{
+    QString host;
+    quint16 port = 3000;
+    int clients = 1000;
+    int threads = 4;
+    double duration = 30;       // Секунды замера
+    double rate = 0;            // Операций в секунду на всех; 0 - замкнутый цикл
+    int weights[MeasuredOps] = {};
+    int messageSize = 64;
+    int pageSize = 50;
+    int connectRate = 500;      // Новых подключений в секунду на этапе подготовки
+    int maxOutstanding = 32;    // Неотвеченных команд на подключение
+    QString password = "loadgen";
+};
+
+enum Phase
+{
+    Setup,
+    Chats,
+    Running,
+    Done
+};
+
+// Общее для всех потоков состояние прогона. Векторы заполняются до запуска
+// потоков и дальше не меняют размер: каждый элемент пишет один клиент.
+struct Shared
+{
+    Options options;
+    QString prefix;
+    QElapsedTimer clock;
+    std::vector<int> userIds;
+    std::vector<int> chatIds;   // По паре клиентов
+    std::atomic<int> ready{0};
+    std::atomic<int> chatsReady{0};
+    std::atomic<int> failed{0};
+    std::atomic<int> outstanding{0};
+    std::atomic<qint64> runStartNs{0};
+    std::atomic<qint64> runEndNs{0};
+
+    QString login(int index) const { return prefix + "u" + QString::number(index); }
+};
+
+struct WorkerStats
+{
+    std::vector<qint64> latenciesUs[MeasuredOps];
+    quint64 errors[MeasuredOps] = {};
+};
+
+class Worker;
+
+class SimClient
+{
+public:
+    SimClient(Worker* worker, Shared* shared, int index);
+    ~SimClient();
+
+    void connectToServer(int delayMs);
+    void startChats();
+    void startRun();
+    int inFlightCount() const { return inFlight.size() + backlog.size(); }
+
+private:
+    struct Request
+    {
+        Op op;
+        qint64 intendedNs;
+        bool measured;
+    };
+
+    void onReadyRead();
+    void onLine(const char* line, int size);
+    void onSetupReply(Op op, bool failed, const QByteArray& fields);
+    void complete(const Request& request, bool failed);
+    void send(Op op, qint64 intendedNs, bool measured);
+    void plan(qint64 intendedNs);
+    void tick();
+    Op pickOp();
+    QByteArray command(Op op);
+    void setupFailed(const QString& reason);
+
+    Worker* worker;
+    Shared* shared;
+    const int index;
+    QTcpSocket* socket;
+    Protocol::LineFramer framer;
+    Phase phase = Setup;
+    QQueue<Request> inFlight;
+    QQueue<Request> backlog;
+    QString login;
+    int userId = -1;
+    int chatId = -1;
+    int peerStep = 2;           // Следующий собеседник для create_chat
+    int registered = 0;
+    qint64 nextAtNs = 0;
+    qint64 intervalNs = 0;
+    QByteArray filler;
+};
+
+class Worker : public QObject
+{
+public:
+    Worker(Shared* shared, int first, int count) : shared(shared), first(first), count(count) {}
+
+    void start()
+    {
+        const int connectRate = qMax(1, shared->options.connectRate);
+        for (int i = 0; i < count; ++i)
+        {
+            const int index = first + i;
+            clients.emplace_back(new SimClient(this, shared, index));
+            // Подключения размазаны по времени, чтобы не упереться в backlog listen()
+            clients.back()->connectToServer(int(qint64(index) * 1000 / connectRate));
+        }
+    }
+    void startChats()
+    {
+        for (auto& client : clients)
+        {
+            client->startChats();
+        }
+    }
+    void startRun()
+    {
+        for (auto& client : clients)
+        {
+            client->startRun();
+        }
+    }
+    void shutdown() { clients.clear(); }
+
+    QRandomGenerator random{QRandomGenerator::global()->generate()};
+    WorkerStats stats;
+
+private:
+    Shared* shared;
+    const int first;
+    const int count;
+    std::vector<std::unique_ptr<SimClient>> clients;
+};
+
+SimClient::SimClient(Worker* worker, Shared* shared, int index)
+    : worker(worker), shared(shared), index(index), socket(new QTcpSocket(worker)), login(shared->login(index))
+{
+    filler = QByteArray(qMax(1, shared->options.messageSize), 'x');
+    QObject::connect(socket, &QTcpSocket::connected, socket, [this]() {
+        send(OpRegister, 0, false);
+    });
+    QObject::connect(socket, &QTcpSocket::readyRead, socket, [this]() { onReadyRead(); });
+    auto onError = [this]() {
+        if (phase != Running && phase != Done)
+        {
+            setupFailed(socket->errorString());
+        }
+        else if (phase == Running)
+        {
+            qWarning() << "Client" << index << "lost connection:" << socket->errorString();
+            shared->outstanding.fetch_sub(inFlightCount());
+            inFlight.clear();
+            backlog.clear();
+            phase = Done;
+        }
+    };
+#if QT_VERSION >= QT_VERSION_CHECK(5, 15, 0)
+    QObject::connect(socket, &QAbstractSocket::errorOccurred, socket, onError);
+#else
+    QObject::connect(socket, QOverload<QAbstractSocket::SocketError>::of(&QAbstractSocket::error), socket, onError);
+#endif
+}
+
+SimClient::~SimClient()
+{
+    phase = Done;
+    socket->disconnect();
+    socket->abort();
+    delete socket;
+}
+
+void SimClient::connectToServer(int delayMs)
+{
+    QTimer::singleShot(delayMs, socket, [this]() {
+        socket->connectToHost(shared->options.host, shared->options.port);
+        socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+    });
+}
+
+void SimClient::setupFailed(const QString& reason)
+{
+    qWarning() << "Client" << index << "failed during setup:" << reason;
+    phase = Done;
+    shared->failed.fetch_add(1);
+}
+
+void SimClient::startChats()
+{
+    phase = Chats;
+    if (index % 2 == 0 && index + 1 < shared->options.clients && userId != -1)
+    {
+        send(OpCreateChat, 0, false);
+    }
+    else
+    {
+        shared->chatsReady.fetch_add(1);
+    }
+}
+
+void SimClient::startRun()
+{
+    if (phase == Done)
+    {
+        return;
+    }
+    phase = Running;
+    chatId = shared->chatIds[size_t(index / 2)];
+    const Options& options = shared->options;
+    const qint64 startNs = shared->runStartNs.load();
+    if (options.rate > 0)
+    {
+        // Открытый цикл: у каждого клиента своё расписание со случайной фазой
+        intervalNs = qint64(options.clients * 1e9 / options.rate);
+        nextAtNs = startNs + qint64(worker->random.bounded(double(qMax<qint64>(1, intervalNs))));
+        tick();
+    }
+    else
+    {
+        plan(shared->clock.nsecsElapsed());
+    }
+}
+
+void SimClient::tick()
+{
+    if (phase != Running)
+    {
+        return;
+    }
+    const qint64 now = shared->clock.nsecsElapsed();
+    const qint64 endNs = shared->runEndNs.load();
+    while (nextAtNs <= now && nextAtNs < endNs)
+    {
+        plan(nextAtNs);
+        nextAtNs += intervalNs;
+    }
+    if (nextAtNs < endNs)
+    {
+        const int delayMs = int((nextAtNs - now + 999999) / 1000000);
+        QTimer::singleShot(delayMs, Qt::PreciseTimer, socket, [this]() { tick(); });
+    }
+}
+
+Op SimClient::pickOp()
+{
+    const int* weights = shared->options.weights;
+    int total = 0;
+    for (int op = 0; op < MeasuredOps; ++op)
+    {
+        total += weights[op];
+    }
+    int roll = int(worker->random.bounded(quint32(qMax(1, total))));
+    Op picked = OpGetChats;
+    for (int op = 0; op < MeasuredOps; ++op)
+    {
+        if (roll < weights[op])
+        {
+            picked = Op(op);
+            break;
+        }
+        roll -= weights[op];
+    }
+    // У клиента без пары нет чата: вместо операций над чатом - список чатов
+    if (chatId == -1 && (picked == OpSendMessage || picked == OpGetMessages))
+    {
+        picked = OpGetChats;
+    }
+    return picked;
+}
+
+void SimClient::plan(qint64 intendedNs)
+{
+    shared->outstanding.fetch_add(1);
+    const Op op = pickOp();
+    if (inFlight.size() < shared->options.maxOutstanding)
+    {
+        send(op, intendedNs, true);
+    }
+    else
+    {
+        backlog.enqueue(Request{op, intendedNs, true});
+    }
+}
+
+QByteArray SimClient::command(Op op)
+{
+    const Options& options = shared->options;
+    QByteArray line = opNames[op];
+    switch (op)
+    {
+    case OpRegister:
+    {
+        // При замере - новые учётные записи, чтобы не упираться в занятый логин
+        const QString name = phase == Setup ? login : login + "r" + QString::number(++registered);
+        line += ':' + Protocol::escape(name) + ':' + options.password.toUtf8();
+        break;
+    }
+    case OpLogin:
+        line += ':' + Protocol::escape(login) + ':' + options.password.toUtf8();
+        break;
+    case OpCreateChat:
+    {
+        int peer = index + 1;
+        if (phase == Running)
+        {
+            // Каждый раз новый собеседник: повторный чат с тем же сервер отклоняет
+            peer = (index + peerStep++) % options.clients;
+        }
+        line += ":loadgen:private:" + Protocol::escape(login) + ':' + Protocol::escape(shared->login(peer));
+        break;
+    }
+    case OpSendMessage:
+        line += ':' + QByteArray::number(chatId) + ':' + QByteArray::number(userId) + ':' + filler;
+        break;
+    case OpGetMessages:
+        line += ':' + QByteArray::number(chatId) + ':' + QByteArray::number(options.pageSize);
+        break;
+    case OpSearch:
+        line += ':' + Protocol::escape("u" + QString::number(worker->random.bounded(qMax(1, options.clients)))) + ":20";
+        break;
+    case OpGetChats:
+    case OpGetUserId:
+        line += ':' + Protocol::escape(login);
+        break;
+    default:
+        break;
+    }
+    line += '\n';
+    return line;
+}
+
+void SimClient::send(Op op, qint64 intendedNs, bool measured)
+{
+    inFlight.enqueue(Request{op, intendedNs, measured});
+    socket->write(command(op));
+}
+
+void SimClient::onReadyRead()
+{
+    framer.append(socket->readAll());
+    const char* line;
+    int size;
+    while (framer.nextLine(&line, &size))
+    {
+        onLine(line, size);
+    }
+}
+
+void SimClient::onLine(const char* line, int size)
+{
+    if (inFlight.isEmpty())
+    {
+        return; // new_message и прочие события сервера
+    }
+    int nameSize = 0;
+    while (nameSize < size && line[nameSize] != ':')
+    {
+        ++nameSize;
+    }
+    const QByteArray name(line, nameSize);
+    const Request request = inFlight.head();
+    // Отказ ("server busy" и т.п.) приходит под именем самой команды
+    if (name != opTerminators[request.op] && name != opNames[request.op])
+    {
+        return;
+    }
+    inFlight.dequeue();
+    const QByteArray fields = nameSize < size ? QByteArray(line + nameSize + 1, size - nameSize - 1) : QByteArray();
+    const bool failed = fields.startsWith("fail");
+    if (request.measured)
+    {
+        complete(request, failed);
+    }
+    else
+    {
+        onSetupReply(request.op, failed, fields);
+    }
+}
+
+void SimClient::complete(const Request& request, bool failed)
+{
+    const qint64 now = shared->clock.nsecsElapsed();
+    worker->stats.latenciesUs[request.op].push_back((now - request.intendedNs) / 1000);
+    if (failed)
+    {
+        ++worker->stats.errors[request.op];
+    }
+    shared->outstanding.fetch_sub(1);
+
+    if (!backlog.isEmpty())
+    {
+        const Request next = backlog.dequeue();
+        send(next.op, next.intendedNs, true);
+    }
+    else if (shared->options.rate <= 0 && phase == Running && now < shared->runEndNs.load())
+    {
+        plan(now);
+    }
+}
+
+void SimClient::onSetupReply(Op op, bool failed, const QByteArray& fields)
+{
+    if (failed)
+    {
+        if (fields.contains("server busy"))
+        {
+            // Очередь БД или хеширования на сервере переполнена: повторяем чуть позже
+            QTimer::singleShot(100, socket, [this, op]() { send(op, 0, false); });
+            return;
+        }
+        setupFailed(QString("%1 failed: %2").arg(opNames[op], QString::fromUtf8(fields)));
+        return;
+    }
+    switch (op)
+    {
+    case OpRegister:
+        send(OpLogin, 0, false);
+        break;
+    case OpLogin:
+        send(OpGetUserId, 0, false);
+        break;
+    case OpGetUserId:
+        userId = fields.toInt();
+        shared->userIds[size_t(index)] = userId;
+        shared->ready.fetch_add(1);
+        break;
+    case OpCreateChat:
+        // create_chat:success:<chat_id>
+        shared->chatIds[size_t(index / 2)] = fields.mid(fields.indexOf(':') + 1).toInt();
+        shared->chatsReady.fetch_add(1);
+        break;
+    default:
+        break;
+    }
+}
+
+double percentileMs(const std::vector<qint64>& sorted, double quantile)
+{
+    if (sorted.empty())
+    {
+        return 0;
+    }
+    size_t rank = size_t(std::ceil(quantile * double(sorted.size())));
+    rank = std::min(sorted.size(), std::max<size_t>(1, rank));
+    return sorted[rank - 1] / 1000.0;
+}
+
+bool parseMix(const QString& text, int* weights)
+{
+    for (int op = 0; op < MeasuredOps; ++op)
+    {
+        weights[op] = 0;
+    }
+    for (const QString& item : text.split(',', QString::SkipEmptyParts))
+    {
+        const QStringList pair = item.split('=');
+        bool ok = false;
+        const int weight = pair.size() == 2 ? pair.at(1).toInt(&ok) : 0;
+        if (!ok || weight < 0)
+        {
+            return false;
+        }
+        int op = 0;
+        while (op < MeasuredOps && pair.at(0).trimmed() != opNames[op])
+        {
+            ++op;
+        }
+        if (op == MeasuredOps)
+        {
+            return false;
+        }
+        weights[op] = weight;
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Load generator for the messenger server");
+    parser.addHelpOption();
+    QCommandLineOption hostOption("host", "Server address.", "host", "127.0.0.1");
+    QCommandLineOption portOption({"p", "port"}, "Server port.", "port", "3000");
+    QCommandLineOption clientsOption("clients", "Number of simulated clients (connections).", "count", "1000");
+    QCommandLineOption threadsOption("threads", "Client threads.", "count", "4");
+    QCommandLineOption durationOption("duration", "Measurement time in seconds.", "seconds", "30");
+    QCommandLineOption rateOption("rate", "Total operations per second; 0 - each client sends the next "
+                                  "operation as soon as the previous one is answered.", "ops", "0");
+    QCommandLineOption mixOption("mix", "Operation weights.", "op=weight,...",
+                                 "send_message=50,get_messages=25,get_chats=10,search=10,login=3,register=1,create_chat=1");
+    QCommandLineOption messageSizeOption("message-size", "Length of sent messages in bytes.", "bytes", "64");
+    QCommandLineOption pageSizeOption("page-size", "Page size of get_messages.", "count", "50");
+    QCommandLineOption connectRateOption("connect-rate", "New connections per second during setup.", "count", "500");
+    QCommandLineOption outstandingOption("max-outstanding", "Unanswered commands per connection before "
+                                         "new ones are held back.", "count", "32");
+    QCommandLineOption outputOption("output", "Also write the JSON report to this file.", "path");
+    parser.addOptions({hostOption, portOption, clientsOption, threadsOption, durationOption, rateOption, mixOption,
+                       messageSizeOption, pageSizeOption, connectRateOption, outstandingOption, outputOption});
+    parser.process(app);
+
+    Shared shared;
+    Options& options = shared.options;
+    options.host = parser.value(hostOption);
+    options.port = quint16(parser.value(portOption).toUInt());
+    options.clients = qMax(1, parser.value(clientsOption).toInt());
+    options.threads = qBound(1, parser.value(threadsOption).toInt(), options.clients);
+    options.duration = qMax(0.1, parser.value(durationOption).toDouble());
+    options.rate = qMax(0.0, parser.value(rateOption).toDouble());
+    options.messageSize = parser.value(messageSizeOption).toInt();
+    options.pageSize = qMax(1, parser.value(pageSizeOption).toInt());
+    options.connectRate = parser.value(connectRateOption).toInt();
+    options.maxOutstanding = qMax(1, parser.value(outstandingOption).toInt());
+    if (!parseMix(parser.value(mixOption), options.weights))
+    {
+        qCritical() << "Invalid operation mix:" << parser.value(mixOption);
+        return 2;
+    }
+
+    // Уникальный префикс логинов: прогоны можно повторять на той же базе
+    shared.prefix = "lg" + QString::number(QDateTime::currentMSecsSinceEpoch(), 36);
+    shared.userIds.assign(size_t(options.clients), -1);
+    shared.chatIds.assign(size_t((options.clients + 1) / 2), -1);
+    shared.clock.start();
+
+    std::vector<QThread*> threads;
+    std::vector<Worker*> workers;
+    const int perThread = (options.clients + options.threads - 1) / options.threads;
+    for (int first = 0; first < options.clients; first += perThread)
+    {
+        QThread* thread = new QThread();
+        Worker* worker = new Worker(&shared, first, qMin(perThread, options.clients - first));
+        worker->moveToThread(thread);
+        thread->start();
+        threads.push_back(thread);
+        workers.push_back(worker);
+        QMetaObject::invokeMethod(worker, [worker]() { worker->start(); }, Qt::QueuedConnection);
+    }
+
+    auto forEachWorker = [&workers](void (Worker::*method)()) {
+        for (Worker* worker : workers)
+        {
+            QMetaObject::invokeMethod(worker, [worker, method]() { (worker->*method)(); }, Qt::QueuedConnection);
+        }
+    };
+
+    // Этапы переключает главный поток, опрашивая счётчики клиентов
+    Phase phase = Setup;
+    int exitCode = 0;
+    qint64 phaseStartNs = shared.clock.nsecsElapsed();
+    const qint64 setupTimeoutNs = qint64(120) * 1000000000;
+    const qint64 drainTimeoutNs = qint64(10) * 1000000000;
+    QTimer poll;
+    QObject::connect(&poll, &QTimer::timeout, [&]() {
+        const qint64 now = shared.clock.nsecsElapsed();
+        if (shared.failed.load() > 0 && phase != Running && phase != Done)
+        {
+            qCritical() << shared.failed.load() << "clients failed during setup";
+            exitCode = 1;
+            app.quit();
+            return;
+        }
+        switch (phase)
+        {
+        case Setup:
+            if (shared.ready.load() == options.clients)
+            {
+                std::fprintf(stderr, "setup: %d clients logged in (%.1f s)\n", options.clients, (now - phaseStartNs) / 1e9);
+                phase = Chats;
+                phaseStartNs = now;
+                forEachWorker(&Worker::startChats);
+            }
+            else if (now - phaseStartNs > setupTimeoutNs)
+            {
+                qCritical() << "Setup timed out:" << shared.ready.load() << "of" << options.clients << "clients ready";
+                exitCode = 1;
+                app.quit();
+            }
+            break;
+        case Chats:
+            if (shared.chatsReady.load() == options.clients)
+            {
+                std::fprintf(stderr, "setup: %d chats created, running for %.0f s\n",
+                             options.clients / 2, options.duration);
+                phase = Running;
+                shared.runStartNs = now;
+                shared.runEndNs = now + qint64(options.duration * 1e9);
+                phaseStartNs = now;
+                forEachWorker(&Worker::startRun);
+            }
+            else if (now - phaseStartNs > setupTimeoutNs)
+            {
+                qCritical() << "Chat creation timed out";
+                exitCode = 1;
+                app.quit();
+            }
+            break;
+        case Running:
+            // После конца замера ждём ответы на уже отправленные команды
+            if (now >= shared.runEndNs.load()
+                && (shared.outstanding.load() == 0 || now - shared.runEndNs.load() > drainTimeoutNs))
+            {
+                phase = Done;
+                app.quit();
+            }
+            break;
+        case Done:
+            break;
+        }
+    });
+    poll.start(20);
+    app.exec();
+    poll.stop();
+
+    const int timeouts = shared.outstanding.load();
+    for (size_t i = 0; i < workers.size(); ++i)
+    {
+        Worker* worker = workers[i];
+        QMetaObject::invokeMethod(worker, [worker]() { worker->shutdown(); }, Qt::BlockingQueuedConnection);
+        threads[i]->quit();
+        threads[i]->wait();
+    }
+    if (phase != Done)
+    {
+        for (size_t i = 0; i < workers.size(); ++i)
+        {
+            delete workers[i];
+            delete threads[i];
+        }
+        return exitCode ? exitCode : 1;
+    }
+
+    // Сводим задержки всех потоков и считаем перцентили по командам
+    const double duration = options.duration;
+    QJsonObject commands;
+    quint64 totalCount = 0;
+    quint64 totalErrors = 0;
+    std::vector<qint64> all;
+    for (int op = 0; op < MeasuredOps; ++op)
+    {
+        std::vector<qint64> latencies;
+        quint64 errors = 0;
+        for (Worker* worker : workers)
+        {
+            const std::vector<qint64>& part = worker->stats.latenciesUs[op];
+            latencies.insert(latencies.end(), part.begin(), part.end());
+            errors += worker->stats.errors[op];
+        }
+        if (latencies.empty())
+        {
+            continue;
+        }
+        std::sort(latencies.begin(), latencies.end());
+        all.insert(all.end(), latencies.begin(), latencies.end());
+        totalCount += latencies.size();
+        totalErrors += errors;
+        QJsonObject entry;
+        entry["count"] = double(latencies.size());
+        entry["errors"] = double(errors);
+        entry["throughput"] = latencies.size() / duration;
+        entry["p50_ms"] = percentileMs(latencies, 0.50);
+        entry["p99_ms"] = percentileMs(latencies, 0.99);
+        entry["p999_ms"] = percentileMs(latencies, 0.999);
+        entry["max_ms"] = latencies.back() / 1000.0;
+        commands[opNames[op]] = entry;
+    }
+    std::sort(all.begin(), all.end());
+    QJsonObject total;
+    total["count"] = double(totalCount);
+    total["errors"] = double(totalErrors);
+    total["throughput"] = totalCount / duration;
+    total["p50_ms"] = percentileMs(all, 0.50);
+    total["p99_ms"] = percentileMs(all, 0.99);
+    total["p999_ms"] = percentileMs(all, 0.999);
+
+    QJsonObject mix;
+    for (int op = 0; op < MeasuredOps; ++op)
+    {
+        if (options.weights[op] > 0)
+        {
+            mix[opNames[op]] = options.weights[op];
+        }
+    }
+    QJsonObject report;
+    report["clients"] = options.clients;
+    report["threads"] = options.threads;
+    report["duration_s"] = duration;
+    report["rate"] = options.rate;
+    report["mix"] = mix;
+    report["timeouts"] = timeouts;
+    report["total"] = total;
+    report["commands"] = commands;
+
+    const QByteArray json = QJsonDocument(report).toJson(QJsonDocument::Indented);
+    std::fwrite(json.constData(), 1, size_t(json.size()), stdout);
+    if (parser.isSet(outputOption))
+    {
+        QFile file(parser.value(outputOption));
+        if (!file.open(QIODevice::WriteOnly) || file.write(json) != json.size())
+        {
+            qCritical() << "Could not write report to" << file.fileName();
+            exitCode = 1;
+        }
+    }
+
+    for (size_t i = 0; i < workers.size(); ++i)
+    {
+        delete workers[i];
+        delete threads[i];
+    }
+    return exitCode;
+}
@@ -0,0 +1,18 @@
+QT -= gui
+QT += core network
+CONFIG += c++14 console
+CONFIG -= app_bundle
+
+# Генератор нагрузки: тысячи клиентов текстового протокола против живого
+# сервера, пропускная способность и p50/p99/p999 по командам в JSON.
+# Сценарий на временной базе: run_scenario.sh.
+
+TARGET = loadgen
+INCLUDEPATH += ..
+
+SOURCES += \
+        loadgen.cpp \
+        ../Protocol.cpp
+
+HEADERS += \
+    ../Protocol.h
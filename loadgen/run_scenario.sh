@@ -0,0 +1,85 @@
+#!/usr/bin/env bash
+# Сценарий нагрузочного прогона на localhost (по умолчанию с одноразовой SQLite-базой).
+# Поднимает сервер в headless-режиме на пустой базе во временном каталоге,
+# прогоняет loadgen и сохраняет JSON-отчёт. Параметры - через окружение:
+#   SERVER   путь к собранному серверу        (по умолчанию ./server)
+#   LOADGEN  путь к собранному loadgen         (по умолчанию ./loadgen)
+#   PORT     порт сервера                      (3900)
+#   CLIENTS  число подключений                 (2000)
+#   DURATION секунды замера                    (30)
+#   RATE     операций в секунду, 0 - без паузы (5000)
+#   OUTPUT   файл отчёта                       (loadgen-report.json)
+#   INSTANCES процессов сервера на одном порту (1); больше одного -
+#            --reuse-port с общей базой и шиной событий
+#   STORAGE  хранилище сервера: sqlite, postgres или memory (sqlite);
+#            memory - потолок пропускной способности без базы, postgres -
+#            база на localhost (--pg-* в SERVER_ARGS), она не очищается
+#   SERVER_ARGS дополнительные аргументы сервера через пробел
+# Остальные аргументы передаются loadgen как есть (например, --mix).
+set -euo pipefail
+
+SERVER=${SERVER:-./server}
+LOADGEN=${LOADGEN:-./loadgen}
+PORT=${PORT:-3900}
+CLIENTS=${CLIENTS:-2000}
+DURATION=${DURATION:-30}
+RATE=${RATE:-5000}
+OUTPUT=${OUTPUT:-loadgen-report.json}
+INSTANCES=${INSTANCES:-1}
+STORAGE=${STORAGE:-sqlite}
+read -r -a extra_args <<< "${SERVER_ARGS:-}"
+
+if [ "$STORAGE" = memory ] && [ "$INSTANCES" -gt 1 ]; then
+    echo "STORAGE=memory can not be shared by several instances" >&2
+    exit 1
+fi
+
+workdir=$(mktemp -d)
+server_pids=()
+cleanup() {
+    for pid in ${server_pids[@]+"${server_pids[@]}"}; do
+        kill "$pid" 2>/dev/null || true
+        wait "$pid" 2>/dev/null || true
+    done
+    rm -rf "$workdir"
+}
+trap cleanup EXIT
+
+# Тысячи подключений упираются в лимит дескрипторов по умолчанию
+ulimit -n "$(( CLIENTS * 2 + 1024 ))" 2>/dev/null || echo "warning: could not raise the open file limit" >&2
+
+wait_for_port() {
+    local pid=$1 log=$2
+    for _ in $(seq 1 100); do
+        if (exec 3<>"/dev/tcp/127.0.0.1/$PORT") 2>/dev/null; then
+            return 0
+        fi
+        if ! kill -0 "$pid" 2>/dev/null; then
+            echo "server exited during startup, log:" >&2
+            cat "$log" >&2 || true
+            exit 1
+        fi
+        sleep 0.1
+    done
+}
+
+# Все клиенты приходят с одного адреса, поэтому лимит хеширования на адрес
+# поднимаем до размера очереди хеширования; число подключений не ограничиваем.
+# Первый процесс создаёт схему, остальные запускаются после него.
+for i in $(seq 1 "$INSTANCES"); do
+    args=(--headless --port "$PORT" --storage "$STORAGE" --db "$workdir/messenger.db"
+          --log "$workdir/server-$i.log" --hash-per-client 256 --max-connections 0
+          ${extra_args[@]+"${extra_args[@]}"})
+    if [ "$INSTANCES" -gt 1 ]; then
+        args+=(--reuse-port --metrics-port $(( 9464 + i - 1 )))
+    fi
+    "$SERVER" "${args[@]}" &
+    server_pids+=($!)
+    if [ "$i" -eq 1 ]; then
+        wait_for_port "$!" "$workdir/server-$i.log"
+    fi
+done
+sleep 0.5 # Остальные процессы подключаются к шине событий
+
+"$LOADGEN" --host 127.0.0.1 --port "$PORT" --clients "$CLIENTS" --duration "$DURATION" --rate "$RATE" \
+    --output "$OUTPUT" "$@"
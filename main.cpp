@@ -1,12 +1,154 @@
-//#include "main.moc"
 #include <QApplication>
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QScopedPointer>
+#include <QThread>
+#include <cstring>
 #include "Server.h"
+#include "ServerWindow.h"
+#include "Logger.h"
+
+// Режим нужно знать до создания приложения: в headless-режиме
+// QApplication (и вместе с ним подключение к дисплею) не создаётся вовсе.
+static bool isHeadless(int argc, char *argv[]) {
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--headless") == 0) {
+            return true;
+        }
+    }
+    return false;
+}
 
 int main(int argc, char *argv[]) {
-    QApplication app(argc, argv);
-    //QCoreApplication app(argc, argv);
-    int port = 3000;
-    Server server;
-    server.startServer(port);
-    return app.exec();
+    const bool headless = isHeadless(argc, argv);
+    QScopedPointer<QCoreApplication> app(headless ? new QCoreApplication(argc, argv)
+                                                  : new QApplication(argc, argv));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Messenger server");
+    parser.addHelpOption();
+    QCommandLineOption headlessOption("headless", "Run without the GUI window.");
+    QCommandLineOption portOption({"p", "port"}, "TCP port to listen on.", "port", "3000");
+    QCommandLineOption storageOption("storage", "Storage backend: sqlite, postgres or memory.", "backend", "sqlite");
+    QCommandLineOption dbOption("db", "Path to the SQLite database.", "path",
+                                QDir::homePath() + "/messenger.db");
+    QCommandLineOption pgHostOption("pg-host", "PostgreSQL host.", "host", "localhost");
+    QCommandLineOption pgPortOption("pg-port", "PostgreSQL port.", "port", "5432");
+    QCommandLineOption pgDatabaseOption("pg-database", "PostgreSQL database name.", "name", "messenger");
+    QCommandLineOption pgUserOption("pg-user", "PostgreSQL user; the password is taken from PGPASSWORD or ~/.pgpass.", "user");
+    QCommandLineOption pgPoolOption("pg-pool", "PostgreSQL connections in the pool (default: database threads + 1).", "count", "0");
+    QCommandLineOption logOption("log", "Path to the log file.", "path",
+                                 QDir::homePath() + "/default_log.txt");
+    QCommandLineOption threadsOption("threads", "Number of reactor threads (default: number of cores).", "count",
+                                     QString::number(QThread::idealThreadCount()));
+    QCommandLineOption reusePortOption("reuse-port", "Share the port with other server processes (SO_REUSEPORT, Linux) "
+                                       "and exchange events with them over a local socket.");
+    QCommandLineOption maxConnectionsOption("max-connections", "Maximum number of client connections (0 - unlimited).", "count", "20000");
+    QCommandLineOption idleTimeoutOption("idle-timeout", "Close connections idle for this many seconds (0 - never).", "seconds", "600");
+    QCommandLineOption dbThreadsOption("db-threads", "Number of database worker threads.", "count", "4");
+    QCommandLineOption dbQueueOption("db-queue", "Maximum number of queued database requests.", "count", "1024");
+    QCommandLineOption identityCacheOption("identity-cache", "Maximum number of cached login/user_id pairs.", "count", "100000");
+    QCommandLineOption batchSizeOption("batch-size", "Maximum number of messages committed in one transaction.", "count", "256");
+    QCommandLineOption batchDelayOption("batch-delay-ms", "How long a message may wait for its batch to fill up.", "ms", "2");
+    QCommandLineOption recentMessagesOption("recent-messages", "Recent messages kept in memory per active chat.", "count", "200");
+    QCommandLineOption messageCacheOption("message-cache-mb", "Memory budget of the recent message cache, 0 disables it.", "mb", "64");
+    QCommandLineOption hashThreadsOption("hash-threads", "Number of password hashing threads.", "count", "2");
+    QCommandLineOption hashQueueOption("hash-queue", "Maximum number of register/login requests waiting for hashing.", "count", "256");
+    QCommandLineOption hashPerClientOption("hash-per-client", "Maximum concurrent register/login requests from one address.", "count", "4");
+    QCommandLineOption hashIterationsOption("hash-iterations", "PBKDF2 iterations for new password hashes.", "count", "50000");
+    QCommandLineOption metricsPortOption("metrics-port", "Local port of the Prometheus /metrics endpoint (0 - disabled).", "port", "9464");
+    QCommandLineOption logMaxSizeOption("log-max-size", "Rotate the log file after this many megabytes.", "mb", "10");
+    QCommandLineOption logFilesOption("log-files", "Number of rotated log files to keep.", "count", "5");
+    parser.addOption(headlessOption);
+    parser.addOption(portOption);
+    parser.addOption(storageOption);
+    parser.addOption(dbOption);
+    parser.addOption(pgHostOption);
+    parser.addOption(pgPortOption);
+    parser.addOption(pgDatabaseOption);
+    parser.addOption(pgUserOption);
+    parser.addOption(pgPoolOption);
+    parser.addOption(logOption);
+    parser.addOption(threadsOption);
+    parser.addOption(reusePortOption);
+    parser.addOption(maxConnectionsOption);
+    parser.addOption(idleTimeoutOption);
+    parser.addOption(dbThreadsOption);
+    parser.addOption(dbQueueOption);
+    parser.addOption(identityCacheOption);
+    parser.addOption(batchSizeOption);
+    parser.addOption(batchDelayOption);
+    parser.addOption(recentMessagesOption);
+    parser.addOption(messageCacheOption);
+    parser.addOption(hashThreadsOption);
+    parser.addOption(hashQueueOption);
+    parser.addOption(hashPerClientOption);
+    parser.addOption(hashIterationsOption);
+    parser.addOption(metricsPortOption);
+    parser.addOption(logMaxSizeOption);
+    parser.addOption(logFilesOption);
+    parser.process(*app);
+
+    bool portOk = false;
+    int port = parser.value(portOption).toInt(&portOk);
+    if (!portOk || port <= 0 || port > 65535) {
+        qCritical() << "Invalid port:" << parser.value(portOption);
+        return 1;
+    }
+
+    StorageConfig storage;
+    if (!StorageConfig::parseKind(parser.value(storageOption), &storage.kind)) {
+        qCritical() << "Unknown storage backend:" << parser.value(storageOption);
+        return 1;
+    }
+    if (storage.kind == StorageConfig::Memory && parser.isSet(reusePortOption)) {
+        // Данные в памяти одного процесса не видны остальным
+        qCritical() << "--storage memory can not be combined with --reuse-port";
+        return 1;
+    }
+    storage.sqlitePath = parser.value(dbOption);
+    storage.pgHost = parser.value(pgHostOption);
+    storage.pgPort = parser.value(pgPortOption).toInt();
+    storage.pgDatabase = parser.value(pgDatabaseOption);
+    storage.pgUser = parser.value(pgUserOption);
+    storage.pgPoolSize = parser.value(pgPoolOption).toInt();
+
+    Logger::getInstance()->setLogFile(parser.value(logOption));
+    Logger::getInstance()->setRotation(parser.value(logMaxSizeOption).toLongLong() * 1024 * 1024,
+                                       parser.value(logFilesOption).toInt());
+
+    int exitCode = 1;
+    {
+        ServerConfig config;
+        config.storage = storage;
+        config.reactorThreads = parser.value(threadsOption).toInt();
+        config.reusePort = parser.isSet(reusePortOption);
+        config.maxConnections = parser.value(maxConnectionsOption).toInt();
+        config.idleTimeoutSec = parser.value(idleTimeoutOption).toInt();
+        config.dbThreads = parser.value(dbThreadsOption).toInt();
+        config.dbQueueCapacity = parser.value(dbQueueOption).toInt();
+        config.identityCacheSize = parser.value(identityCacheOption).toInt();
+        config.messageBatchSize = parser.value(batchSizeOption).toInt();
+        config.messageBatchDelayMs = parser.value(batchDelayOption).toInt();
+        config.recentMessagesPerChat = parser.value(recentMessagesOption).toInt();
+        config.recentMessagesBudget = parser.value(messageCacheOption).toLongLong() * 1024 * 1024;
+        config.hashThreads = parser.value(hashThreadsOption).toInt();
+        config.hashQueueCapacity = parser.value(hashQueueOption).toInt();
+        config.hashPerClient = parser.value(hashPerClientOption).toInt();
+        config.hashIterations = parser.value(hashIterationsOption).toInt();
+        config.metricsPort = parser.value(metricsPortOption).toInt();
+        Server server(config);
+        bool started = server.startServer(port);
+
+        QScopedPointer<ServerWindow> window;
+        if (!headless) {
+            window.reset(new ServerWindow(&server));
+            window->show();
+        }
+        if (started || !headless) {
+            exitCode = app->exec();
+        }
+    }
+    Logger::getInstance()->shutdown(); // Дописываем хвост очереди логов
+    return exitCode;
 }
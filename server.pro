@@ -1,9 +1,9 @@
 QT += core gui widgets
 QT += network core
 QT += sql
-CONFIG += c++11
+CONFIG += c++14
 
-CONFIG += c++11 console
+CONFIG += c++14 console
 CONFIG -= app_bundle
 
 # You can make your code fail to compile if it uses deprecated APIs.
@@ -11,8 +11,29 @@ CONFIG -= app_bundle
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
 SOURCES += \
+        ClientConnection.cpp \
+        DbExecutor.cpp \
+        EventBus.cpp \
+        IdentityCache.cpp \
         Logger.cpp \
+        LogTail.cpp \
+        MemoryStorage.cpp \
+        MessageWriter.cpp \
+        Metrics.cpp \
+        PasswordHasher.cpp \
+        PostgresStorage.cpp \
+        Protocol.cpp \
+        Reactor.cpp \
+        RecentMessageCache.cpp \
         Server.cpp \
+        ServerWindow.cpp \
+        SqliteStorage.cpp \
+        SqlStorage.cpp \
+        StatsEndpoint.cpp \
+        StatsReport.cpp \
+        Storage.cpp \
+        UserRegistry.cpp \
+        UserSearchIndex.cpp \
         main.cpp
 
 TRANSLATIONS += \
@@ -29,5 +50,28 @@ else: unix:!android: target.path = /opt/$${TARGET}/bin
 !isEmpty(target.path): INSTALLS += target
 
 HEADERS += \
+    ClientConnection.h \
+    DbExecutor.h \
+    EventBus.h \
+    IdentityCache.h \
     Logger.h \
-    Server.h
+    LogTail.h \
+    MemoryStorage.h \
+    MessageWriter.h \
+    Metrics.h \
+    Models.h \
+    MpscQueue.h \
+    PasswordHasher.h \
+    PostgresStorage.h \
+    Protocol.h \
+    Reactor.h \
+    RecentMessageCache.h \
+    Server.h \
+    ServerWindow.h \
+    SqliteStorage.h \
+    SqlStorage.h \
+    StatsEndpoint.h \
+    StatsReport.h \
+    Storage.h \
+    UserRegistry.h \
+    UserSearchIndex.h
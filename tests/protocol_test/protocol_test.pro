@@ -0,0 +1,15 @@
+QT -= gui
+QT += core testlib
+CONFIG += c++14 console testcase
+CONFIG -= app_bundle
+
+# Тесты разбора текстового протокола (Protocol.cpp). Запуск: qmake && make check.
+
+INCLUDEPATH += ../..
+
+SOURCES += \
+        tst_protocol.cpp \
+        ../../Protocol.cpp
+
+HEADERS += \
+    ../../Protocol.h
@@ -0,0 +1,364 @@
+#include <QtTest>
+#include "Protocol.h"
+
+class ProtocolTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void splitsEscapedFields();
+    void lastFieldTakesRestOfLine();
+    void trailingBackslashIsKept();
+    void escapeRoundTrip();
+    void parsesIntegers();
+    void parsesIntegers_data();
+    void textReplyRoundTrip();
+    void decodesFrame();
+    void acceptsEveryCommandOpcode();
+    void rejectsMalformedFrame();
+    void rejectsMalformedFrame_data();
+    void binaryReplyRoundTrip();
+    void pipelinedCommandsDoNotOverflow();
+    void longLineOverflows();
+    void longLineAfterHeldLinesOverflows();
+};
+
+static QList<QString> split(const QByteArray& line, int maxFields)
+{
+    Protocol::FieldView fields[Protocol::MaxFields];
+    const int count = Protocol::splitFields(line.constData(), line.size(), fields, maxFields);
+    QList<QString> result;
+    for (int i = 0; i < count; ++i)
+    {
+        result.append(fields[i].toString());
+    }
+    return result;
+}
+
+void ProtocolTest::splitsEscapedFields()
+{
+    // Разделитель - только неэкранированное ':'; экранирование снимает toString
+    // search:a\:b\\c:d\n
+    QCOMPARE(split("search:a\\:b\\\\c:d\\n", 4), QList<QString>() << "search" << "a:b\\c" << "d\n");
+}
+
+void ProtocolTest::lastFieldTakesRestOfLine()
+{
+    // Старые клиенты не экранируют ':' в тексте сообщения
+    QCOMPARE(split("send_message:1:2:hello: world:", 4),
+             QList<QString>() << "send_message" << "1" << "2" << "hello: world:");
+    QCOMPARE(split("send_message:1:2:a\\:b", 4), QList<QString>() << "send_message" << "1" << "2" << "a:b");
+    QCOMPARE(split("get_chats", 2), QList<QString>() << "get_chats");
+    QCOMPARE(split("search:", 4), QList<QString>() << "search" << "");
+}
+
+void ProtocolTest::trailingBackslashIsKept()
+{
+    // Одинокая обратная косая черта в конце строки ничего не экранирует
+    // и остаётся как есть
+    QCOMPARE(split("search:abc\\", 4), QList<QString>() << "search" << "abc\\");
+    // Перед ':' она экранирует двоеточие, и поле не заканчивается
+    QCOMPARE(split("search:abc\\:", 4), QList<QString>() << "search" << "abc:");
+    QCOMPARE(Protocol::FieldView().toString(), QString());
+}
+
+void ProtocolTest::escapeRoundTrip()
+{
+    const QString original = QString::fromUtf8("a:b\\c\nd\\:e\\n ж");
+    const QByteArray escaped = Protocol::escape(original);
+    QVERIFY(!escaped.contains('\n'));
+    QCOMPARE(escaped, QByteArray("a\\:b\\\\c\\nd\\\\\\:e\\\\n ") + QString::fromUtf8("ж").toUtf8());
+    QCOMPARE(split("search:" + escaped + ":x", 3), QList<QString>() << "search" << original << "x");
+    QCOMPARE(Protocol::escape("plain"), QByteArray("plain"));
+}
+
+void ProtocolTest::parsesIntegers_data()
+{
+    QTest::addColumn<QByteArray>("text");
+    QTest::addColumn<bool>("valid");
+    QTest::addColumn<int>("value");
+
+    QTest::newRow("zero") << QByteArray("0") << true << 0;
+    QTest::newRow("positive") << QByteArray("42") << true << 42;
+    QTest::newRow("negative") << QByteArray("-17") << true << -17;
+    QTest::newRow("int max") << QByteArray("2147483647") << true << 2147483647;
+    QTest::newRow("int min") << QByteArray("-2147483648") << true << int(-2147483647 - 1);
+    QTest::newRow("int max + 1") << QByteArray("2147483648") << false << 0;
+    QTest::newRow("int min - 1") << QByteArray("-2147483649") << false << 0;
+    QTest::newRow("long overflow") << QByteArray("99999999999999999999999") << false << 0;
+    QTest::newRow("empty") << QByteArray() << false << 0;
+    QTest::newRow("minus only") << QByteArray("-") << false << 0;
+    QTest::newRow("letters") << QByteArray("12a") << false << 0;
+    QTest::newRow("plus") << QByteArray("+1") << false << 0;
+    QTest::newRow("space") << QByteArray(" 1") << false << 0;
+}
+
+void ProtocolTest::parsesIntegers()
+{
+    QFETCH(QByteArray, text);
+    QFETCH(bool, valid);
+    QFETCH(int, value);
+
+    Protocol::FieldView field;
+    field.data = text.constData();
+    field.size = text.size();
+    bool ok = !valid;
+    QCOMPARE(field.toInt(&ok), value);
+    QCOMPARE(ok, valid);
+}
+
+void ProtocolTest::textReplyRoundTrip()
+{
+    const QString text = QString::fromUtf8("привет: a\\b\nc");
+    QByteArray out;
+    {
+        Protocol::ReplyWriter reply(&out, Protocol::Mode::Text, Protocol::Reply::MessageItem, 77);
+        reply << text << 42 << qint64(-5000000000LL) << "success";
+    }
+    QVERIFY(out.endsWith('\n'));
+    QCOMPARE(out.count('\n'), 1); // Перевод строки в тексте экранирован
+    out.chop(1);
+
+    Protocol::FieldView fields[Protocol::MaxFields];
+    QCOMPARE(Protocol::splitFields(out.constData(), out.size(), fields, 5), 5);
+    QCOMPARE(fields[0].toString(), QString("message_item"));
+    QCOMPARE(fields[1].toString(), text);
+    QCOMPARE(fields[2].toInt(), 42);
+    bool ok = true;
+    fields[3].toInt(&ok);
+    QVERIFY(!ok); // Не помещается в int
+    QCOMPARE(fields[3].toString(), QString("-5000000000"));
+    QCOMPARE(fields[4].toString(), QString("success"));
+}
+
+static void appendUInt32(QByteArray* out, quint32 value)
+{
+    out->append(char(value >> 24));
+    out->append(char(value >> 16));
+    out->append(char(value >> 8));
+    out->append(char(value));
+}
+
+// Начало бинарного кадра без поля длины: код операции и id запроса.
+static QByteArray frameHead(int opcode, quint32 requestId)
+{
+    QByteArray frame(1, char(opcode));
+    appendUInt32(&frame, requestId);
+    return frame;
+}
+
+static QByteArray integerField(qint64 value)
+{
+    QByteArray field(1, char(Protocol::IntegerField));
+    appendUInt32(&field, quint32(quint64(value) >> 32));
+    appendUInt32(&field, quint32(value));
+    return field;
+}
+
+static QByteArray bytesField(const QByteArray& value)
+{
+    QByteArray field(1, char(Protocol::BytesField));
+    appendUInt32(&field, quint32(value.size()));
+    return field + value;
+}
+
+static int decode(const QByteArray& frame, Protocol::FieldView* fields, Protocol::Command* command = nullptr,
+                  quint32* requestId = nullptr)
+{
+    Protocol::Command decodedCommand;
+    quint32 decodedId = 0;
+    const int count = Protocol::decodeFrame(frame.constData(), frame.size(), &decodedCommand, &decodedId,
+                                            fields, Protocol::MaxFields);
+    if (command)
+    {
+        *command = decodedCommand;
+    }
+    if (requestId)
+    {
+        *requestId = decodedId;
+    }
+    return count;
+}
+
+void ProtocolTest::decodesFrame()
+{
+    const QByteArray frame = frameHead(int(Protocol::Command::SendMessage) + 1, 0x01020304)
+        + integerField(5) + integerField(-7) + bytesField("a\\:b\nc");
+    Protocol::FieldView fields[Protocol::MaxFields];
+    Protocol::Command command;
+    quint32 requestId = 0;
+    QCOMPARE(decode(frame, fields, &command, &requestId), 4);
+    QCOMPARE(int(command), int(Protocol::Command::SendMessage));
+    QCOMPARE(requestId, quint32(0x01020304));
+    QVERIFY(fields[0].isEmpty());
+    QCOMPARE(fields[0].toString(), QString());
+    QCOMPARE(fields[1].toInt(), 5);
+    QCOMPARE(fields[2].toInt(), -7);
+    // Байты бинарного поля не разэкранируются
+    QCOMPARE(fields[3].kind, Protocol::FieldView::Raw);
+    QCOMPARE(fields[3].toString(), QString("a\\:b\nc"));
+
+    // Пустое байтовое поле - тоже поле
+    QCOMPARE(decode(frameHead(1, 0) + bytesField(QByteArray()), fields), 2);
+    QVERIFY(fields[1].isEmpty());
+}
+
+void ProtocolTest::acceptsEveryCommandOpcode()
+{
+    Protocol::FieldView fields[Protocol::MaxFields];
+    for (int i = 0; i < int(Protocol::Command::Count); ++i)
+    {
+        Protocol::Command command;
+        QCOMPARE(decode(frameHead(i + 1, 1), fields, &command), 1);
+        QCOMPARE(int(command), i);
+    }
+    // Ровно MaxFields полей вместе с fields[0] - ещё допустимо
+    QByteArray frame = frameHead(1, 1);
+    for (int i = 1; i < Protocol::MaxFields; ++i)
+    {
+        frame += integerField(i);
+    }
+    QCOMPARE(decode(frame, fields), Protocol::MaxFields);
+}
+
+void ProtocolTest::rejectsMalformedFrame_data()
+{
+    QTest::addColumn<QByteArray>("frame");
+
+    const QByteArray head = frameHead(1, 1);
+    QByteArray tooManyFields = head;
+    for (int i = 0; i < Protocol::MaxFields; ++i)
+    {
+        tooManyFields += integerField(i);
+    }
+    QByteArray hugeLength = head + char(Protocol::BytesField);
+    appendUInt32(&hugeLength, 0xffffffffu);
+    hugeLength += "abc";
+
+    QTest::newRow("empty") << QByteArray();
+    QTest::newRow("truncated header") << head.left(4);
+    QTest::newRow("opcode 0") << frameHead(0, 1);
+    QTest::newRow("opcode Count + 1") << frameHead(int(Protocol::Command::Count) + 1, 1);
+    QTest::newRow("reply opcode") << frameHead(Protocol::ReplyOpcodeBase, 1);
+    QTest::newRow("integer type only") << head + char(Protocol::IntegerField);
+    QTest::newRow("truncated integer") << head + integerField(5).left(5);
+    QTest::newRow("bytes type only") << head + char(Protocol::BytesField);
+    QTest::newRow("truncated bytes length") << head + bytesField("abc").left(3);
+    QTest::newRow("bytes past end") << head + bytesField("abcdef").left(8);
+    QTest::newRow("huge bytes length") << hugeLength;
+    QTest::newRow("unknown field type") << head + char(3) + integerField(5).mid(1);
+    QTest::newRow("field type 0") << head + char(0);
+    QTest::newRow("too many fields") << tooManyFields;
+    QTest::newRow("garbage after field") << head + integerField(5) + char(Protocol::IntegerField) + "xy";
+}
+
+void ProtocolTest::rejectsMalformedFrame()
+{
+    QFETCH(QByteArray, frame);
+    Protocol::FieldView fields[Protocol::MaxFields];
+    QCOMPARE(decode(frame, fields), -1);
+}
+
+// Поля ответа кодируются так же, как поля запроса, поэтому ответ после
+// подмены кода операции разбирается decodeFrame.
+void ProtocolTest::binaryReplyRoundTrip()
+{
+    const QString text = QString::fromUtf8("привет: a\\b\nc");
+    QByteArray out = "prefix";
+    {
+        Protocol::ReplyWriter reply(&out, Protocol::Mode::Binary, Protocol::Reply::MessageItem, 77);
+        reply << text << 42 << qint64(-5000000000LL) << "success" << QString();
+    }
+    QVERIFY(out.startsWith("prefix"));
+    QByteArray frame = out.mid(6);
+    QVERIFY(frame.size() > 4);
+    const uchar* length = reinterpret_cast<const uchar*>(frame.constData());
+    QCOMPARE(int((length[0] << 24) | (length[1] << 16) | (length[2] << 8) | length[3]), frame.size() - 4);
+    frame.remove(0, 4);
+    QCOMPARE(int(uchar(frame.at(0))), Protocol::ReplyOpcodeBase + int(Protocol::Reply::MessageItem));
+    frame[0] = char(1);
+
+    Protocol::FieldView fields[Protocol::MaxFields];
+    quint32 requestId = 0;
+    QCOMPARE(decode(frame, fields, nullptr, &requestId), 6);
+    QCOMPARE(requestId, quint32(77));
+    QCOMPARE(fields[1].kind, Protocol::FieldView::Raw);
+    QCOMPARE(fields[1].toString(), text);
+    QCOMPARE(fields[2].kind, Protocol::FieldView::Integer);
+    QCOMPARE(fields[2].toInt(), 42);
+    QCOMPARE(fields[3].number, qint64(-5000000000LL));
+    bool ok = true;
+    fields[3].toInt(&ok);
+    QVERIFY(!ok); // Не помещается в int
+    QCOMPARE(fields[4].toString(), QString("success"));
+    QVERIFY(fields[5].isEmpty());
+}
+
+// Клиент шлёт больше MaxLineSize коротких команд разом, а сервер разбирает
+// только несколько: ответы не уходят, потому что клиент не читает
+// (ClientConnection останавливает разбор при заполненном выходном буфере).
+// Полные строки ждут в буфере и не должны приводить к разрыву.
+void ProtocolTest::pipelinedCommandsDoNotOverflow()
+{
+    const QByteArray command = "get_chats:alice\n";
+    const int count = 2 * Protocol::MaxLineSize / command.size();
+    QByteArray data;
+    for (int i = 0; i < count; ++i)
+    {
+        data += command;
+    }
+    QVERIFY(data.size() > Protocol::MaxLineSize);
+
+    Protocol::LineFramer framer;
+    framer.append(data);
+    const char* line;
+    int size;
+    for (int i = 0; i < 10; ++i)
+    {
+        QVERIFY(framer.nextLine(&line, &size));
+    }
+    QVERIFY(framer.bufferedBytes() > Protocol::MaxLineSize);
+    QVERIFY(!framer.overflowed());
+
+    // Хвост следующей команды пришёл без '\n' - это тоже не переполнение
+    framer.append("get_ch");
+    QVERIFY(!framer.overflowed());
+
+    int taken = 10;
+    while (framer.nextLine(&line, &size))
+    {
+        QCOMPARE(QByteArray(line, size), command.left(command.size() - 1));
+        ++taken;
+    }
+    QCOMPARE(taken, count);
+    QCOMPARE(framer.bufferedBytes(), 6);
+    QVERIFY(!framer.overflowed());
+}
+
+void ProtocolTest::longLineOverflows()
+{
+    Protocol::LineFramer framer;
+    framer.append(QByteArray(Protocol::MaxLineSize, 'x'));
+    QVERIFY(!framer.overflowed());
+    framer.append("x");
+    QVERIFY(framer.overflowed());
+}
+
+void ProtocolTest::longLineAfterHeldLinesOverflows()
+{
+    Protocol::LineFramer framer;
+    framer.append("get_chats:alice\nget_chats:bob\n");
+    framer.append(QByteArray(Protocol::MaxLineSize + 1, 'x'));
+    QVERIFY(framer.overflowed());
+
+    // После разбора полных строк недописанная по-прежнему слишком длинная
+    const char* line;
+    int size;
+    QVERIFY(framer.nextLine(&line, &size));
+    framer.append("x");
+    QVERIFY(framer.overflowed());
+}
+
+QTEST_APPLESS_MAIN(ProtocolTest)
+
+#include "tst_protocol.moc"
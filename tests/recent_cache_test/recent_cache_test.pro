@@ -0,0 +1,16 @@
+QT -= gui
+QT += core testlib
+CONFIG += c++14 console testcase
+CONFIG -= app_bundle
+
+# Тесты кэша последних сообщений (RecentMessageCache.cpp). Запуск: qmake && make check.
+
+INCLUDEPATH += ../..
+
+SOURCES += \
+        tst_recentmessagecache.cpp \
+        ../../RecentMessageCache.cpp
+
+HEADERS += \
+    ../../RecentMessageCache.h \
+    ../../Models.h
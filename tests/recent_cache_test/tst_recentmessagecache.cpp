@@ -0,0 +1,59 @@
+#include <QtTest>
+#include "RecentMessageCache.h"
+
+class RecentMessageCacheTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void appendAfterLoadSkipsLoadedMessage();
+};
+
+static ChatMessage message(int messageId)
+{
+    ChatMessage result;
+    result.messageId = messageId;
+    result.senderId = 1;
+    result.timestamp = 1000 + messageId;
+    result.text = QString("message %1").arg(messageId);
+    return result;
+}
+
+static QList<int> ids(const MessagePage& page)
+{
+    QList<int> result;
+    for (const ChatMessage& item : page.messages)
+    {
+        result.append(item.messageId);
+    }
+    return result;
+}
+
+// MessageWriter вызывает append после COMMIT. Если чат успели загрузить
+// между ними, сообщение уже есть в буфере и не должно попасть туда дважды.
+void RecentMessageCacheTest::appendAfterLoadSkipsLoadedMessage()
+{
+    const int chatId = 7;
+    RecentMessageCache cache(10, 1024 * 1024);
+    QVERIFY(cache.beginLoad(chatId));
+    cache.finishLoad(chatId, QList<ChatMessage>() << message(1) << message(2) << message(3), true);
+    QVERIFY(cache.contains(chatId));
+
+    cache.append(chatId, message(3));
+    cache.append(chatId, message(2)); // Старше последнего - тоже пропускается
+
+    MessageCursor latest;
+    latest.chatId = chatId;
+    latest.limit = 10;
+    MessagePage page;
+    QVERIFY(cache.read(latest, &page));
+    QCOMPARE(ids(page), QList<int>() << 1 << 2 << 3);
+
+    cache.append(chatId, message(4));
+    QVERIFY(cache.read(latest, &page));
+    QCOMPARE(ids(page), QList<int>() << 1 << 2 << 3 << 4);
+}
+
+QTEST_APPLESS_MAIN(RecentMessageCacheTest)
+
+#include "tst_recentmessagecache.moc"
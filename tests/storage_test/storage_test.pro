@@ -0,0 +1,19 @@
+QT -= gui
+QT += core sql testlib
+CONFIG += c++14 console testcase
+CONFIG -= app_bundle
+
+# Тесты SQL-хранилища на временном файле SQLite. Запуск: qmake && make check.
+
+INCLUDEPATH += ../..
+
+SOURCES += \
+        tst_storage.cpp \
+        ../../SqliteStorage.cpp \
+        ../../SqlStorage.cpp
+
+HEADERS += \
+    ../../SqliteStorage.h \
+    ../../SqlStorage.h \
+    ../../Storage.h \
+    ../../Models.h
@@ -0,0 +1,116 @@
+#include <QtTest>
+#include <QSqlDatabase>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QTemporaryDir>
+#include "SqliteStorage.h"
+
+class StorageTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+    void failedMessageDoesNotAbortBatch();
+
+private:
+    // Выполняет SQL в отдельном соединении с файлом базы.
+    bool execute(const QString& statement);
+
+    QTemporaryDir dir;
+    QString path;
+    SqliteStorage* storage = nullptr;
+};
+
+void StorageTest::init()
+{
+    QVERIFY(dir.isValid());
+    path = dir.filePath(QString("messenger-%1.db").arg(QTest::currentTestFunction()));
+    storage = new SqliteStorage(path);
+    QVERIFY(storage->open());
+}
+
+void StorageTest::cleanup()
+{
+    storage->releaseThread();
+    delete storage;
+    storage = nullptr;
+}
+
+bool StorageTest::execute(const QString& statement)
+{
+    bool ok = false;
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", "storage-test-setup");
+        db.setDatabaseName(path);
+        if (db.open())
+        {
+            QSqlQuery query(db);
+            ok = query.exec(statement);
+            if (!ok)
+            {
+                qWarning() << query.lastError().text();
+            }
+        }
+        db.close();
+    }
+    QSqlDatabase::removeDatabase("storage-test-setup");
+    return ok;
+}
+
+// Сообщение из середины партии не записывается; остальные должны
+// сохраниться вместе со счётчиками непрочитанных и сводкой чата, а не
+// пропасть вместе с оборванной транзакцией.
+void StorageTest::failedMessageDoesNotAbortBatch()
+{
+    const int alice = storage->addUser("alice", "hash");
+    const int bob = storage->addUser("bob", "hash");
+    QVERIFY(alice > 0 && bob > 0);
+    const int chatId = storage->createChat("dialog", "private");
+    QVERIFY(chatId > 0);
+    QVERIFY(storage->addParticipant(chatId, alice));
+    QVERIFY(storage->addParticipant(chatId, bob));
+    QVERIFY(execute("CREATE TRIGGER reject_message BEFORE INSERT ON messages "
+                    "WHEN NEW.message_text = 'rejected' BEGIN SELECT RAISE(ABORT, 'message rejected'); END"));
+
+    QVector<NewMessage> batch;
+    for (const char* text : {"first", "rejected", "third"})
+    {
+        NewMessage message;
+        message.chatId = chatId;
+        message.userId = alice;
+        message.text = text;
+        batch.append(message);
+    }
+    QVector<StoredMessage> results;
+    storage->appendMessages(batch, QDateTime::currentDateTimeUtc(), &results);
+
+    QCOMPARE(results.size(), 3);
+    QVERIFY(results[0].error.isEmpty());
+    QVERIFY(results[0].messageId > 0);
+    QVERIFY(!results[1].error.isEmpty());
+    QCOMPARE(results[1].messageId, -1);
+    QVERIFY(results[2].error.isEmpty());
+    QVERIFY(results[2].messageId > results[0].messageId);
+
+    MessageCursor cursor;
+    cursor.chatId = chatId;
+    cursor.limit = 10;
+    bool ok = false;
+    const MessagePage page = storage->loadMessagePage(cursor, &ok);
+    QVERIFY(ok);
+    QCOMPARE(page.messages.size(), 2);
+    QCOMPARE(page.messages[0].text, QString("first"));
+    QCOMPARE(page.messages[1].text, QString("third"));
+
+    const QList<ChatListItem> chats = storage->chatsForUser(bob);
+    QCOMPARE(chats.size(), 1);
+    QCOMPARE(chats[0].unreadCount, 2);
+    QCOMPARE(chats[0].lastMessage.messageId, results[2].messageId);
+    QCOMPARE(chats[0].lastMessage.text, QString("third"));
+}
+
+QTEST_GUILESS_MAIN(StorageTest)
+
+#include "tst_storage.moc"